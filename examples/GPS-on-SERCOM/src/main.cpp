@@ -12,9 +12,30 @@ Uart gpsSerial (&sercom2, 3, 4, SERCOM_RX_PAD_1, UART_TX_PAD_0);
 
 GPS_EM506 gps(&gpsSerial);
 
+/*
+ * Sentences are parsed right in the interrupt, and finished epochs wait in 'fixes'
+ * until loop() gets to them, so a long SD write can't overflow the core's small UART
+ * ring. 16 epochs is 16 s at 1 Hz. (To parse in loop() instead, push the bytes onto an
+ * SPSCQueue<uint8_t, N> here and call gps.CheckQueue() from loop().)
+ */
+SPSCQueue<GPSDatum, 16> fixes;
+
 void SERCOM2_Handler()
 {
   gpsSerial.IrqHandler();
+  while(gpsSerial.available()) gps.Ingest(gpsSerial.read());
+}
+
+/*
+ * begin() muxes the pins back to their default SERCOM, so this has to follow every
+ * time the GPS class opens the port -- including when it looks for the receiver at
+ * other rates.
+ */
+void MuxGPSPins(uint32_t baud, void* context)
+{
+  //assign pins 3 & 4 SERCOM functionality
+  pinPeripheral(3, PIO_SERCOM_ALT);
+  pinPeripheral(4, PIO_SERCOM_ALT);
 }
 
 void setup() 
@@ -25,20 +46,21 @@ void setup()
 
   delay(500);
 
-  gps.Init();
-  
-  //assign pins 3 & 4 SERCOM functionality
-  pinPeripheral(3, PIO_SERCOM_ALT);
-  pinPeripheral(4, PIO_SERCOM_ALT);
+  gps.OnBaud(MuxGPSPins);
+  gps.Begin(); //doesn't wait; PollCommands() moves it along
 
-  gps.SetActiveNMEAStrings(GGA | RMC);
+  gps.SetActiveNMEAStrings(GGA | RMC); //queued; sent by PollCommands() below
+  gps.OnEpoch(GPSQueueDatum<16>, &fixes);
 
   SerialUSB.println(F("Setup complete."));
 
   SerialUSB.println(F("Checking for signal."));
-  while(!(gps.CheckSerial() & RMC) && !SerialUSB.available()) {}
-
-  GPSDatum gpsDatum = gps.GetReading();  
+  GPSDatum gpsDatum;
+  while(!(gpsDatum.source & RMC) && !SerialUSB.available()) 
+  {
+    gps.PollCommands(); //parsing happens in the interrupt, so configuration goes out from here
+    if(!fixes.Pop(gpsDatum)) __WFI(); //nothing to do until the next interrupt
+  }
   
   //now we have a fix -- make a filename
 
@@ -52,10 +74,18 @@ void setup()
 
 void loop() 
 {
-  if(gps.CheckSerial() & GGA) //if we have a GGA
-  {
-    String reportStr = gps.GetReading().MakeDataString();
+  gps.PollCommands();
 
-    SerialUSB.println(reportStr);  
+  GPSDatum fix;
+  if(fixes.Pop(fix))
+  {
+    if(fix.source & GGA)
+    {
+      char line[64];
+      fix.FormatCSV(line, sizeof(line));
+      SerialUSB.println(line);
+    }
   }
+
+  else __WFI(); //sleep until the next interrupt
 }
\ No newline at end of file
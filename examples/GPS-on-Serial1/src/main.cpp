@@ -28,6 +28,29 @@ GPS_EM506 gps(&Serial1);
 //  gpsSerial.IrqHandler();
 //}
 
+bool haveFix = false;
+
+void ReportInit(uint8_t state, uint8_t attempt, void*) //see GPS_INIT_STATE
+{
+  if(state == GPS_INIT_READY)
+  {
+    SerialUSB.print(F("GPS is up at "));
+    SerialUSB.println(gps.GetBaud());
+  }
+  if(state == GPS_INIT_FAILED) SerialUSB.println(F("No GPS."));
+}
+
+void ReportEpoch(const GPSDatum& epoch, void*) //called from gps.Dispatch() for each completed epoch
+{
+  if(epoch.source & RMC) haveFix = true;
+  if(epoch.source & GGA)
+  {
+    char line[64];
+    epoch.FormatCSV(line, sizeof(line));
+    SerialUSB.println(line);
+  }
+}
+
 void setup() 
 {
   delay(2000);
@@ -42,12 +65,18 @@ void setup()
 
   delay(2000);
 
-  gps.Init();
+  gps.OnInit(ReportInit);
+  gps.SetBaudTarget(57600); //finds the receiver's rate, then raises it
+  gps.Begin(); //doesn't wait; Dispatch() moves it along
+  gps.OnEpoch(ReportEpoch);
   
   SerialUSB.println(F("Setup complete."));
 
   SerialUSB.println(F("Checking for signal."));
-  while(!(gps.CheckSerial() & RMC) && !SerialUSB.available()) {}
+  while(!haveFix && !SerialUSB.available()) 
+  {
+    if(!gps.Dispatch()) __WFI(); //nothing to do until the next interrupt
+  }
 
   GPSDatum gpsDatum = gps.GetReading();  
   
@@ -63,12 +92,7 @@ void setup()
 
 void loop() 
 {
-  if(gps.CheckSerial() & GGA) //if we have a GGA
-  {
-    String reportStr = gps.GetReading().MakeDataString();
-
-    SerialUSB.println(reportStr);  
-  }
-
+  //reports come out through ReportEpoch(); sleep when the UART has nothing for us
+  if(!gps.Dispatch()) __WFI();
 }
 
@@ -0,0 +1,185 @@
+#include <Arduino.h>
+
+#include <ctype.h>
+#include <chrono>
+#include <thread>
+
+/*
+ * Clock. By default it follows the host's steady clock; once a tool calls
+ * HostSetMicros() it becomes a simulated clock that only moves when told to.
+ */
+static bool simulatedClock = false;
+static uint32_t simulatedMicros = 0;
+
+static uint64_t HostMicros(void)
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t micros(void) {return simulatedClock ? simulatedMicros : (uint32_t)HostMicros();}
+uint32_t millis(void) {return simulatedClock ? simulatedMicros / 1000 : (uint32_t)(HostMicros() / 1000);}
+
+void delayMicroseconds(uint32_t us)
+{
+    if(simulatedClock) simulatedMicros += us;
+    else std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void delay(uint32_t ms) {delayMicroseconds(ms * 1000);}
+
+void HostSetMicros(uint32_t us) {simulatedClock = true; simulatedMicros = us;}
+void HostAdvanceMicros(uint32_t us) {simulatedClock = true; simulatedMicros += us;}
+
+/*
+ * Pins. Writes are stored; reads return whatever was last written or set.
+ */
+static uint8_t pinState[64];
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t val) {if(pin < sizeof(pinState)) pinState[pin] = val;}
+int digitalRead(uint8_t pin) {return pin < sizeof(pinState) ? pinState[pin] : LOW;}
+void HostSetPin(uint8_t pin, uint8_t val) {digitalWrite(pin, val);}
+
+/*
+ * String, allocating the same way the Arduino core does (realloc on growth,
+ * no small-string buffer) so that heap behaviour on the host is representative.
+ */
+uint32_t hostHeapAllocs = 0;
+
+bool String::Reserve(unsigned int size)
+{
+    if(buffer && capacity >= size) return true;
+
+    char* newBuffer = (char*)realloc(buffer, size + 1);
+    if(!newBuffer) return false;
+    hostHeapAllocs++;
+
+    if(!buffer) newBuffer[0] = 0;
+    buffer = newBuffer;
+    capacity = size;
+    return true;
+}
+
+String& String::Copy(const char* str, unsigned int length)
+{
+    if(!Reserve(length)) return *this;
+    memmove(buffer, str, length);
+    buffer[length] = 0;
+    len = length;
+    return *this;
+}
+
+String::String(const char* str) {Copy(str, strlen(str));}
+String::String(const char* str, unsigned int length) {Copy(str, length);}
+String::String(const String& str) {Copy(str.c_str(), str.len);}
+String::String(char c) {Copy(&c, 1);}
+
+static void FormatNumber(String& str, unsigned long value, bool negative, unsigned char base)
+{
+    char buf[8 * sizeof(long) + 2];
+    char* p = &buf[sizeof(buf) - 1];
+    *p = 0;
+
+    do
+    {
+        uint8_t digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= base;
+    } while(value);
+
+    if(negative) *--p = '-';
+    str = p;
+}
+
+String::String(unsigned char value, unsigned char base) {FormatNumber(*this, value, false, base);}
+String::String(unsigned int value, unsigned char base) {FormatNumber(*this, value, false, base);}
+String::String(unsigned long value, unsigned char base) {FormatNumber(*this, value, false, base);}
+
+String::String(int value, unsigned char base)
+{
+    if(base == DEC && value < 0) FormatNumber(*this, -(long)value, true, base);
+    else FormatNumber(*this, (unsigned int)value, false, base);
+}
+
+String::String(long value, unsigned char base)
+{
+    if(base == DEC && value < 0) FormatNumber(*this, -(unsigned long)value, true, base);
+    else FormatNumber(*this, (unsigned long)value, false, base);
+}
+
+String::~String(void) {free(buffer);}
+
+String& String::operator = (const String& rhs)
+{
+    if(this != &rhs) Copy(rhs.c_str(), rhs.len);
+    return *this;
+}
+
+String& String::operator = (const char* rhs) {return Copy(rhs, strlen(rhs));}
+
+String& String::operator += (const char* rhs)
+{
+    unsigned int n = strlen(rhs);
+    if(!Reserve(len + n)) return *this;
+    memcpy(buffer + len, rhs, n + 1);
+    len += n;
+    return *this;
+}
+
+String& String::operator += (const String& rhs) {return *this += String(rhs).c_str();}
+
+String& String::operator += (char c)
+{
+    char str[2] = {c, 0};
+    return *this += str;
+}
+
+char& String::operator [] (unsigned int index)
+{
+    static char dummy;
+    if(index >= len) return dummy = 0;
+    return buffer[index];
+}
+
+bool String::equals(const String& s) const
+{
+    return len == s.len && strcmp(c_str(), s.c_str()) == 0;
+}
+
+int String::indexOf(char c, unsigned int fromIndex) const
+{
+    if(fromIndex >= len) return -1;
+    const char* p = strchr(buffer + fromIndex, c);
+    return p ? p - buffer : -1;
+}
+
+String String::substring(unsigned int left, unsigned int right) const
+{
+    if(left > right) {unsigned int t = left; left = right; right = t;}
+    if(left >= len) return String();
+    if(right > len) right = len;
+    return String(buffer + left, right - left);
+}
+
+void String::toUpperCase(void)
+{
+    for(unsigned int i = 0; i < len; i++) buffer[i] = toupper(buffer[i]);
+}
+
+long String::toInt(void) const {return atol(c_str());}
+float String::toFloat(void) const {return atof(c_str());}
+
+String operator + (const String& lhs, const String& rhs) {String s(lhs); s += rhs; return s;}
+String operator + (const String& lhs, const char* rhs) {String s(lhs); s += rhs; return s;}
+String operator + (const String& lhs, char rhs) {String s(lhs); s += rhs; return s;}
+String operator + (char lhs, const String& rhs) {String s(lhs); s += rhs; return s;}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size)
+{
+    for(size_t i = 0; i < size; i++) write(buf[i]);
+    return size;
+}
+
+size_t HardwareSerial::print(const char* str) {return write((const uint8_t*)str, strlen(str));}
+size_t HardwareSerial::print(const String& str) {return print(str.c_str());}
@@ -0,0 +1,133 @@
+#ifndef __HOST_ARDUINO_H
+#define __HOST_ARDUINO_H
+
+/*
+ * Minimal stand-in for the Arduino core so that the library can be built and
+ * exercised on a desktop. Only what src/ actually uses is provided.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef uint8_t byte;
+
+#define HEX 16
+#define DEC 10
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+
+#define F(str) (str)
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+//host-only hooks so that tools can drive the clock and the pins
+void HostSetMicros(uint32_t us);
+void HostAdvanceMicros(uint32_t us);
+void HostSetPin(uint8_t pin, uint8_t val);
+
+extern uint32_t hostHeapAllocs; //number of heap (re)allocations made by String
+
+class String
+{
+protected:
+    char* buffer = nullptr;
+    unsigned int capacity = 0;
+    unsigned int len = 0;
+
+    bool Reserve(unsigned int size);
+    String& Copy(const char* str, unsigned int length);
+
+public:
+    String(const char* str = "");
+    String(const char* str, unsigned int length);
+    String(const String& str);
+    explicit String(char c);
+    String(unsigned char value, unsigned char base = DEC);
+    String(int value, unsigned char base = DEC);
+    String(unsigned int value, unsigned char base = DEC);
+    String(long value, unsigned char base = DEC);
+    String(unsigned long value, unsigned char base = DEC);
+    ~String(void);
+
+    String& operator = (const String& rhs);
+    String& operator = (const char* rhs);
+
+    String& operator += (const String& rhs);
+    String& operator += (const char* rhs);
+    String& operator += (char c);
+
+    bool reserve(unsigned int size) {return Reserve(size);}
+    unsigned int length(void) const {return len;}
+    const char* c_str(void) const {return buffer ? buffer : "";}
+
+    char operator [] (unsigned int index) const {return index < len ? buffer[index] : 0;}
+    char& operator [] (unsigned int index);
+
+    bool equals(const String& s) const;
+    bool operator == (const String& rhs) const {return equals(rhs);}
+    bool operator != (const String& rhs) const {return !equals(rhs);}
+    bool operator == (const char* rhs) const {return strcmp(c_str(), rhs) == 0;}
+    bool operator != (const char* rhs) const {return strcmp(c_str(), rhs) != 0;}
+
+    int indexOf(char c, unsigned int fromIndex = 0) const;
+    String substring(unsigned int left) const {return substring(left, len);}
+    String substring(unsigned int left, unsigned int right) const;
+
+    void toUpperCase(void);
+    long toInt(void) const;
+    float toFloat(void) const;
+};
+
+String operator + (const String& lhs, const String& rhs);
+String operator + (const String& lhs, const char* rhs);
+String operator + (const String& lhs, char rhs);
+String operator + (char lhs, const String& rhs);
+
+/*
+ * Serial stand-in. Byte-level behaviour follows the Arduino Stream API; the
+ * host versions of begin() and write() just record what they were given.
+ */
+class HardwareSerial
+{
+protected:
+    uint32_t baud = 0;
+    bool ready = true;
+
+public:
+    virtual ~HardwareSerial(void) {}
+
+    virtual void begin(uint32_t b) {baud = b;}
+    virtual void end(void) {baud = 0;}
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual size_t write(uint8_t b) = 0;
+    virtual void flush(void) {}
+
+    size_t write(const uint8_t* buf, size_t size);
+    size_t print(const String& str);
+    size_t print(const char* str);
+
+    uint32_t GetBaud(void) const {return baud;}
+    void SetReady(bool r) {ready = r;} //false plays a USB port that nobody has opened
+
+    operator bool(void) {return ready;}
+};
+
+#endif
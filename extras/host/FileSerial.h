@@ -0,0 +1,64 @@
+#ifndef __FILE_SERIAL_H
+#define __FILE_SERIAL_H
+
+#include <Arduino.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+
+/*
+ * A HardwareSerial whose receive side is a captured log. Bytes are released in
+ * chunks, the way a UART ring looks to the library when it is polled from loop():
+ * available() reports only what has been released by NextChunk(). Anything the
+ * library writes is kept in 'sent' so tools can inspect outgoing commands.
+ */
+class FileSerial : public HardwareSerial
+{
+protected:
+    std::vector<uint8_t> data;
+    size_t readIndex = 0;
+    size_t releasedIndex = 0;
+    size_t chunkSize = 64;
+
+public:
+    std::vector<uint8_t> sent;
+
+public:
+    FileSerial(size_t chunk = 64) : chunkSize(chunk ? chunk : 1) {}
+
+    bool Load(const char* filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if(!file) return false;
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        Rewind();
+        return true;
+    }
+
+    void Load(const uint8_t* bytes, size_t length)
+    {
+        data.assign(bytes, bytes + length);
+        Rewind();
+    }
+
+    void Rewind(void) {readIndex = releasedIndex = 0;}
+
+    size_t NextChunk(void) //releases the next chunk; returns the number of bytes released
+    {
+        size_t start = releasedIndex;
+        releasedIndex += chunkSize;
+        if(releasedIndex > data.size()) releasedIndex = data.size();
+        return releasedIndex - start;
+    }
+
+    bool Done(void) const {return readIndex >= data.size();}
+    size_t Size(void) const {return data.size();}
+
+    int available(void) {return releasedIndex - readIndex;}
+    int read(void) {return readIndex < releasedIndex ? data[readIndex++] : -1;}
+    size_t write(uint8_t b) {sent.push_back(b); return 1;}
+};
+
+#endif
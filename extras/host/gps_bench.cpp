@@ -0,0 +1,502 @@
+/*
+ * Microbenchmarks for each stage of the parsing path, with heap allocation counts.
+ *
+ *   gps_bench [-m ms] [-s results] [-b baseline [-t percent]]
+ *
+ *   -m  minimum time spent on each stage (default 200 ms)
+ *   -s  save the results to a file, to be used later as a baseline
+ *   -b  compare against a saved baseline; exits with 1 if any stage is slower by
+ *       more than the threshold or allocates more per operation
+ *   -t  regression threshold in percent (default 10)
+ *
+ * The corpora are generated with a fixed seed: a mix of GGA, RMC, GSA and GSV with
+ * some bad checksums and truncated lines, and SiRF frames of the navigation MIDs
+ * with some corrupt frames and line noise.
+ */
+
+#include <gps.h>
+#include <gps_geo.h>
+#include <gps_fence.h>
+#include "FileSerial.h"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include <map>
+
+/*
+ * allocation counting: String goes through hostHeapAllocs; everything else through new
+ */
+static uint32_t newAllocs = 0;
+
+void* operator new(size_t size)
+{
+    newAllocs++;
+    void* p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {return operator new(size);}
+void operator delete(void* p) noexcept {free(p);}
+void operator delete[](void* p) noexcept {free(p);}
+void operator delete(void* p, size_t) noexcept {free(p);}
+void operator delete[](void* p, size_t) noexcept {free(p);}
+
+static uint32_t AllocCount(void) {return hostHeapAllocs + newAllocs;}
+
+/*
+ * corpus generation
+ */
+static uint32_t seed = 12345;
+static uint32_t Random(uint32_t n) {seed = seed * 1103515245 + 12345; return (seed >> 8) % n;}
+
+static std::string Finish(const std::string& body) //adds '$', checksum and <CR><LF>
+{
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X\r\n", GPS::CalcChecksum(body.c_str(), body.length()));
+    return "$" + body + tail;
+}
+
+struct NMEACorpus
+{
+    std::vector<std::string> lines; //complete lines, as they come off the wire
+    std::vector<std::string> gga, rmc; //valid sentences without <CR><LF>, as CheckSerial hands them to ParseNMEA
+    std::vector<std::string> latitudes, times;
+    std::string stream;
+};
+
+static NMEACorpus MakeNMEACorpus(int epochs)
+{
+    NMEACorpus corpus;
+    char buf[128];
+
+    int lat = 42 * 600000 + 16 * 10000 + 1234, lon = 71 * 600000 + 48 * 10000 + 5678;
+    int tod = 12 * 3600 + 34 * 60;
+
+    for(int i = 0; i < epochs; i++, tod++)
+    {
+        lat += Random(40) - 20;
+        lon += Random(40) - 20;
+
+        char timeStr[16], latStr[16], lonStr[16];
+        snprintf(timeStr, sizeof(timeStr), "%02d%02d%02d.000", tod / 3600 % 24, tod / 60 % 60, tod % 60);
+        snprintf(latStr, sizeof(latStr), "%02d%02d.%04d", lat / 600000, lat / 10000 % 60, lat % 10000);
+        snprintf(lonStr, sizeof(lonStr), "%03d%02d.%04d", lon / 600000, lon / 10000 % 60, lon % 10000);
+
+        std::vector<std::string> epoch;
+
+        snprintf(buf, sizeof(buf), "GPGGA,%s,%s,N,%s,W,1,%02u,0.9,%u.%u,M,-33.8,M,,0000",
+                 timeStr, latStr, lonStr, 5 + Random(7), 40 + Random(20), Random(10));
+        epoch.push_back(Finish(buf));
+
+        snprintf(buf, sizeof(buf), "GPGSA,A,3,07,02,26,27,09,04,15,,,,,,1.8,1.0,1.5");
+        epoch.push_back(Finish(buf));
+
+        for(int g = 1; g <= 3; g++)
+        {
+            snprintf(buf, sizeof(buf), "GPGSV,3,%d,11,%02u,%02u,%03u,%02u,%02u,%02u,%03u,%02u,%02u,%02u,%03u,%02u,%02u,%02u,%03u,%02u",
+                     g, Random(32), Random(90), Random(360), Random(50), Random(32), Random(90), Random(360), Random(50),
+                     Random(32), Random(90), Random(360), Random(50), Random(32), Random(90), Random(360), Random(50));
+            epoch.push_back(Finish(buf));
+        }
+
+        snprintf(buf, sizeof(buf), "GPRMC,%s,A,%s,N,%s,W,%u.%02u,%u.%02u,170326,,,A",
+                 timeStr, latStr, lonStr, Random(5), Random(100), Random(360), Random(100));
+        epoch.push_back(Finish(buf));
+
+        corpus.latitudes.push_back(latStr);
+        corpus.times.push_back(timeStr);
+
+        for(std::string& line : epoch)
+        {
+            uint32_t r = Random(100);
+            if(r < 8) line[7 + Random(line.length() - 12)] ^= 0x01; //bad checksum
+            else if(r < 12) line = line.substr(0, 8 + Random(line.length() - 10)) + "\r\n"; //truncated
+            else if(line.compare(3, 3, "GGA") == 0) corpus.gga.push_back(line.substr(0, line.length() - 2));
+            else if(line.compare(3, 3, "RMC") == 0) corpus.rmc.push_back(line.substr(0, line.length() - 2));
+
+            corpus.lines.push_back(line);
+            corpus.stream += line;
+        }
+    }
+
+    return corpus;
+}
+
+static std::string MakeSiRFCorpus(int epochs)
+{
+    FileSerial serial;
+    GPS_JF2 gps(&serial, GPS_BINARY);
+
+    const uint8_t mids[] = {41, 2, 7, 4};
+    const uint16_t lengths[] = {91, 41, 20, 188};
+
+    uint8_t payload[188];
+    for(int i = 0; i < epochs; i++)
+    {
+        for(int m = 0; m < 4; m++)
+        {
+            payload[0] = mids[m];
+            for(int j = 1; j < lengths[m]; j++) payload[j] = Random(256);
+
+            size_t start = serial.sent.size();
+            gps.SendBinary(payload, lengths[m]);
+
+            if(Random(100) < 5) serial.sent[start + 6 + Random(lengths[m] - 2)] ^= 0x10; //corrupt payload
+        }
+
+        for(uint32_t n = Random(4); n; n--) serial.sent.push_back(Random(256)); //line noise
+    }
+
+    return std::string(serial.sent.begin(), serial.sent.end());
+}
+
+/*
+ * timing
+ */
+struct FenceCorpus
+{
+    std::vector<GPSFencePoint> vertices;
+    std::vector<uint16_t> polygons;
+    std::vector<uint16_t> cells, entries;
+    GPSFenceSet set;
+};
+
+static void MakeFenceCorpus(FenceCorpus& fences, const GPSDatum& center, int count) //star-ish polygons around the corpus track
+{
+    fences.polygons.push_back(0);
+    for(int p = 0; p < count; p++)
+    {
+        int32_t lat = center.lat + (int32_t)Random(6000) - 3000, lon = center.lon + (int32_t)Random(8000) - 4000;
+        int radius = 100 + Random(900), n = 3 + Random(10);
+        for(int i = 0; i < n; i++)
+        {
+            double r = i % 2 ? radius * (40 + Random(60)) / 100.0 : radius, a = 2 * M_PI * i / n;
+            GPSFencePoint v = {lat + (int32_t)(r * sin(a)), lon + (int32_t)(r * cos(a) / 0.74)};
+            fences.vertices.push_back(v);
+        }
+
+        fences.polygons.push_back(fences.vertices.size());
+    }
+
+    fences.set = {fences.vertices.data(), fences.polygons.data(), (uint16_t)count};
+    fences.cells.resize(16 * 16 + 1);
+    fences.entries.resize(GPSFenceIndex(fences.set, 16, 16, fences.cells.data(), nullptr, 0));
+    GPSFenceIndex(fences.set, 16, 16, fences.cells.data(), fences.entries.data(), fences.entries.size());
+}
+
+struct StageResult
+{
+    double nsPerOp = 0;
+    double nsPerByte = 0;
+    double opsPerSec = 0;
+    double allocsPerOp = 0;
+};
+
+static double minSeconds = 0.2;
+static volatile uint32_t sink = 0;
+
+static StageResult RunStage(size_t opsPerRound, size_t bytesPerRound, const std::function<void(void)>& round)
+{
+    StageResult result;
+
+    round(); //warm up
+
+    uint32_t allocs = AllocCount();
+    round();
+    result.allocsPerOp = (double)(AllocCount() - allocs) / opsPerRound;
+
+    uint64_t rounds = 0;
+    double seconds = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while(seconds < minSeconds)
+    {
+        round();
+        rounds++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    result.nsPerOp = seconds * 1e9 / (rounds * opsPerRound);
+    result.nsPerByte = bytesPerRound ? seconds * 1e9 / (rounds * bytesPerRound) : 0;
+    result.opsPerSec = rounds * opsPerRound / seconds;
+
+    return result;
+}
+
+static size_t TotalLength(const std::vector<std::string>& strings)
+{
+    size_t total = 0;
+    for(const std::string& s : strings) total += s.length();
+    return total;
+}
+
+static std::vector<String> ToStrings(const std::vector<std::string>& strings)
+{
+    std::vector<String> out;
+    for(const std::string& s : strings) out.push_back(String(s.c_str()));
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    const char* saveFile = nullptr;
+    const char* baselineFile = nullptr;
+    double threshold = 10;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-m") && i + 1 < argc) minSeconds = atof(argv[++i]) / 1000;
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc) saveFile = argv[++i];
+        else if(!strcmp(argv[i], "-b") && i + 1 < argc) baselineFile = argv[++i];
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc) threshold = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-m ms] [-s results] [-b baseline [-t percent]]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    NMEACorpus nmea = MakeNMEACorpus(200);
+    std::string sirf = MakeSiRFCorpus(200);
+
+    std::vector<String> lineStrings = ToStrings(nmea.lines);
+    std::vector<String> latStrings = ToStrings(nmea.latitudes);
+    std::vector<String> timeStrings = ToStrings(nmea.times);
+    std::vector<String> ggaStrings = ToStrings(nmea.gga);
+
+    FileSerial serial;
+    GPS_EM506 gps(&serial);
+    GPS_JF2 gpsBinary(&serial, GPS_BINARY);
+
+    std::vector<GPSDatum> ggaData, rmcData;
+    for(const std::string& s : nmea.gga) ggaData.push_back(gps.ParseNMEA(s.c_str(), s.length()));
+    for(const std::string& s : nmea.rmc) rmcData.push_back(gps.ParseNMEA(s.c_str(), s.length()));
+
+    std::vector<std::pair<std::string, StageResult> > results;
+
+    results.push_back(std::make_pair("CalcChecksum", RunStage(nmea.lines.size(), nmea.stream.length(), [&]()
+    {
+        for(const std::string& s : nmea.lines) sink += GPS::CalcChecksum(s.c_str() + 1, s.length() - 6);
+    })));
+
+    results.push_back(std::make_pair("GetNMEASubstring (fields 1-9)", RunStage(ggaStrings.size(), TotalLength(nmea.gga), [&]()
+    {
+        for(const String& s : ggaStrings)
+            for(int f = 1; f <= 9; f++) sink += GPSDatum::GetNMEASubstring(s, f).length();
+    })));
+
+    results.push_back(std::make_pair("ConvertToDMM", RunStage(latStrings.size(), TotalLength(nmea.latitudes), [&]()
+    {
+        for(const String& s : latStrings) sink += GPSDatum::ConvertToDMM(s);
+    })));
+
+    results.push_back(std::make_pair("NMEAtoTime", RunStage(timeStrings.size(), TotalLength(nmea.times), [&]()
+    {
+        GPSDatum datum;
+        for(const String& s : timeStrings) sink += datum.NMEAtoTime(s) + datum.second;
+    })));
+
+    results.push_back(std::make_pair("ParseNMEA GGA", RunStage(nmea.gga.size(), TotalLength(nmea.gga), [&]()
+    {
+        for(const std::string& s : nmea.gga) sink += gps.ParseNMEA(s.c_str(), s.length()).source;
+    })));
+
+    results.push_back(std::make_pair("ParseNMEA RMC", RunStage(nmea.rmc.size(), TotalLength(nmea.rmc), [&]()
+    {
+        for(const std::string& s : nmea.rmc) sink += gps.ParseNMEA(s.c_str(), s.length()).source;
+    })));
+
+    results.push_back(std::make_pair("GPSDatum::Merge", RunStage(ggaData.size(), 0, [&]()
+    {
+        for(size_t i = 0; i < ggaData.size() && i < rmcData.size(); i++)
+        {
+            GPSDatum working = ggaData[i];
+            sink += working.Merge(rmcData[i]);
+        }
+    })));
+
+    results.push_back(std::make_pair("GPSEpochAssembler", RunStage(ggaData.size(), 0, [&]()
+    {
+        GPSEpochAssembler epochs;
+        for(size_t i = 0; i < ggaData.size() && i < rmcData.size(); i++)
+        {
+            epochs.Add(ggaData[i]);
+            epochs.Add(rmcData[i]);
+            sink += epochs.Check(ggaData[i].timestamp);
+        }
+    })));
+
+    results.push_back(std::make_pair("MakeDataString", RunStage(ggaData.size(), 0, [&]()
+    {
+        for(GPSDatum& datum : ggaData) sink += datum.MakeDataString().length();
+    })));
+
+    results.push_back(std::make_pair("FormatCSV", RunStage(ggaData.size(), 0, [&]()
+    {
+        char line[64];
+        for(GPSDatum& datum : ggaData) sink += datum.FormatCSV(line, sizeof(line));
+    })));
+
+    results.push_back(std::make_pair("FormatJSON", RunStage(ggaData.size(), 0, [&]()
+    {
+        char line[200];
+        for(GPSDatum& datum : ggaData) sink += datum.FormatJSON(line, sizeof(line));
+    })));
+
+    results.push_back(std::make_pair("GPSDatum::EpochMS", RunStage(rmcData.size(), 0, [&]()
+    {
+        for(GPSDatum& datum : rmcData) sink += datum.EpochMS();
+    })));
+
+    results.push_back(std::make_pair("GPSDatum::SetEpochMS", RunStage(rmcData.size(), 0, [&]()
+    {
+        GPSDatum working(0);
+        for(GPSDatum& datum : rmcData)
+        {
+            working.SetEpochMS(datum.EpochMS());
+            sink += working.day;
+        }
+    })));
+
+    //distance and bearing from each fix to a waypoint, against the float version they replace
+    const int32_t wpLat = 25326000, wpLon = -43080000;
+
+    results.push_back(std::make_pair("GeoDistanceFast", RunStage(ggaData.size(), 0, [&]()
+    {
+        for(GPSDatum& datum : ggaData) sink += GeoDistanceFast(datum.lat, datum.lon, wpLat, wpLon);
+    })));
+
+    results.push_back(std::make_pair("GeoDistance", RunStage(ggaData.size(), 0, [&]()
+    {
+        for(GPSDatum& datum : ggaData) sink += GeoDistance(datum.lat, datum.lon, wpLat, wpLon);
+    })));
+
+    results.push_back(std::make_pair("GeoBearing", RunStage(ggaData.size(), 0, [&]()
+    {
+        for(GPSDatum& datum : ggaData) sink += GeoBearing(datum.lat, datum.lon, wpLat, wpLon);
+    })));
+
+    results.push_back(std::make_pair("haversine (float)", RunStage(ggaData.size(), 0, [&]()
+    {
+        const float k = M_PI / 180 / 600000;
+        for(GPSDatum& datum : ggaData)
+        {
+            float phi1 = datum.lat * k, phi2 = wpLat * k, dLambda = (wpLon - datum.lon) * k;
+            float s1 = sinf((phi2 - phi1) / 2), s2 = sinf(dLambda / 2);
+            float a = s1 * s1 + cosf(phi1) * cosf(phi2) * s2 * s2;
+            sink += 2 * 6371008.8f * atan2f(sqrtf(a), sqrtf(1 - a));
+        }
+    })));
+
+    //300 geofences: the grid index against testing every polygon
+    FenceCorpus fences;
+    MakeFenceCorpus(fences, ggaData[0], 300);
+    GPSGeofence fence(fences.set);
+
+    results.push_back(std::make_pair("GPSGeofence::Update (300)", RunStage(ggaData.size(), 0, [&]()
+    {
+        for(GPSDatum& datum : ggaData) sink += fence.Update(datum);
+    })));
+
+    results.push_back(std::make_pair("GPSFenceContains (all 300)", RunStage(ggaData.size(), 0, [&]()
+    {
+        for(GPSDatum& datum : ggaData)
+            for(uint16_t p = 0; p < fences.set.polygonCount; p++) sink += GPSFenceContains(fences.set, p, datum.lat, datum.lon);
+    })));
+
+    results.push_back(std::make_pair("CheckSerial (NMEA stream)", RunStage(nmea.lines.size(), nmea.stream.length(), [&]()
+    {
+        serial.Load((const uint8_t*)nmea.stream.data(), nmea.stream.length());
+        while(!serial.Done())
+        {
+            serial.NextChunk();
+            sink += gps.CheckSerial();
+        }
+    })));
+
+    results.push_back(std::make_pair("CheckSerial (filter GGA|RMC)", RunStage(nmea.lines.size(), nmea.stream.length(), [&]()
+    {
+        gps.SetSentenceFilter(GGA | RMC);
+        serial.Load((const uint8_t*)nmea.stream.data(), nmea.stream.length());
+        while(!serial.Done())
+        {
+            serial.NextChunk();
+            sink += gps.CheckSerial();
+        }
+        gps.SetSentenceFilter(0);
+    })));
+
+    results.push_back(std::make_pair("CheckSerialBinary", RunStage(800, sirf.length(), [&]()
+    {
+        serial.Load((const uint8_t*)sirf.data(), sirf.length());
+        while(!serial.Done())
+        {
+            serial.NextChunk();
+            uint8_t result;
+            do
+            {
+                result = gpsBinary.CheckSerialBinary();
+                sink += (result == COMPLETE);
+            } while(result == COMPLETE || result >= LENGTH_ERROR);
+        }
+    })));
+
+    printf("%-30s %12s %10s %14s %11s\n", "stage", "ns/op", "ns/byte", "ops/s", "allocs/op");
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const StageResult& r = results[i].second;
+        printf("%-30s %12.1f %10.2f %14.0f %11.2f\n", results[i].first.c_str(), r.nsPerOp, r.nsPerByte, r.opsPerSec, r.allocsPerOp);
+    }
+
+    if(saveFile)
+    {
+        FILE* file = fopen(saveFile, "w");
+        if(!file) {fprintf(stderr, "cannot write %s\n", saveFile); return 2;}
+        for(size_t i = 0; i < results.size(); i++)
+            fprintf(file, "%s\t%f\t%f\n", results[i].first.c_str(), results[i].second.nsPerOp, results[i].second.allocsPerOp);
+        fclose(file);
+    }
+
+    int regressions = 0;
+    if(baselineFile)
+    {
+        FILE* file = fopen(baselineFile, "r");
+        if(!file) {fprintf(stderr, "cannot read %s\n", baselineFile); return 2;}
+
+        std::map<std::string, std::pair<double, double> > baseline;
+        char line[256];
+        while(fgets(line, sizeof(line), file))
+        {
+            char* tab = strchr(line, '\t');
+            if(!tab) continue;
+            *tab = 0;
+            double ns = 0, allocs = 0;
+            if(sscanf(tab + 1, "%lf %lf", &ns, &allocs) == 2) baseline[line] = std::make_pair(ns, allocs);
+        }
+        fclose(file);
+
+        printf("\n%-30s %12s %12s %9s\n", "stage", "baseline", "now", "change");
+        for(size_t i = 0; i < results.size(); i++)
+        {
+            std::map<std::string, std::pair<double, double> >::iterator base = baseline.find(results[i].first);
+            if(base == baseline.end()) continue;
+
+            const StageResult& r = results[i].second;
+            double change = (r.nsPerOp / base->second.first - 1) * 100;
+            bool slower = change > threshold;
+            bool moreAllocs = r.allocsPerOp > base->second.second + 0.005;
+
+            printf("%-30s %12.1f %12.1f %+8.1f%%%s%s\n", results[i].first.c_str(), base->second.first, r.nsPerOp, change,
+                   slower ? "  SLOWER" : "", moreAllocs ? "  MORE ALLOCS" : "");
+            regressions += slower || moreAllocs;
+        }
+
+        if(regressions) printf("\n%d stage(s) regressed beyond %.1f%%\n", regressions, threshold);
+    }
+
+    return regressions ? 1 : 0;
+}
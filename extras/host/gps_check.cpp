@@ -0,0 +1,1414 @@
+/*
+ * Regression checks for the parts of the library that can be checked exactly on a
+ * desktop. Runs every group (or just the ones named) and exits with 1 if any check
+ * fails; `make check` builds and runs it.
+ *
+ *   gps_check [-v] [group ...]
+ *
+ *   -v  print each group's tally, not just failures
+ *
+ * Inputs are generated with a fixed seed, so a failure reproduces.
+ */
+
+#include <gps.h>
+#include <gps_track.h>
+#include <gps_fence.h>
+#include <gps_geo.h>
+#include <gps_sirf.h>
+#include <gps_command.h>
+#include "FileSerial.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+static uint32_t checks = 0, failures = 0;
+
+#define CHECK(condition, ...) do \
+{ \
+    checks++; \
+    if(!(condition)) \
+    { \
+        if(failures++ < 20) \
+        { \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+        } \
+    } \
+} while(0)
+
+static uint32_t seed = 12345;
+static uint32_t Random(uint32_t n) {seed = seed * 1103515245 + 12345; return (seed >> 8) % n;}
+
+/*
+ * track log: a long, wandering track through many blocks, decoded block by block
+ */
+static std::vector<GPSDatum> MakeTrack(uint32_t count)
+{
+    std::vector<GPSDatum> track;
+    GPSDatum datum(0);
+    datum.year = 24;
+    datum.month = 2;
+    datum.day = 28;
+    datum.SetTimeOfDayMS(86400000UL - 600000); //ten minutes to midnight, to cross two of them
+    datum.lat = 25326000;
+    datum.lon = -43080000;
+    datum.elevDM = 1200;
+    datum.gpsFix = 1;
+    datum.source = GGA | RMC;
+
+    uint64_t time = datum.EpochMS();
+    for(uint32_t i = 0; i < count; i++)
+    {
+        time += Random(10) ? 1000 : 200 + Random(5000); //mostly 1 Hz, with gaps
+        datum.SetEpochMS(time);
+
+        datum.lat += (int32_t)Random(401) - 200;
+        datum.lon += (int32_t)Random(401) - 200;
+        if(!Random(50)) datum.lat += (int32_t)Random(2000001) - 1000000; //the odd jump
+        datum.elevDM += (int32_t)Random(21) - 10;
+        if(!Random(500)) datum.gpsFix = 3 - datum.gpsFix; //1 <-> 2
+
+        track.push_back(datum);
+        if(i == count / 2) time += 86400000UL - 1200000; //on to just before the next midnight
+    }
+
+    return track;
+}
+
+static void CheckTrackCodec(void)
+{
+    const uint32_t count = 200000;
+    std::vector<GPSDatum> track = MakeTrack(count);
+
+    //encode in 512-byte blocks, as an SD logger would
+    uint8_t buffer[512];
+    GPSTrackEncoder encoder(buffer, sizeof(buffer), 60);
+    std::vector<std::vector<uint8_t> > blocks;
+
+    for(const GPSDatum& datum : track)
+    {
+        if(encoder.Add(datum)) continue;
+
+        blocks.push_back(std::vector<uint8_t>(buffer, buffer + encoder.Pad()));
+        encoder.Clear();
+        CHECK(encoder.Add(datum), "a fix didn't fit in an empty block");
+    }
+
+    blocks.push_back(std::vector<uint8_t>(buffer, buffer + encoder.GetLength()));
+
+    //each block decodes on its own
+    uint32_t n = 0;
+    for(const std::vector<uint8_t>& block : blocks)
+    {
+        GPSTrackDecoder decoder(block.data(), block.size());
+        GPSDatum datum(0);
+        uint32_t inBlock = 0;
+        while(decoder.Next(datum) && n < count)
+        {
+            const GPSDatum& want = track[n++];
+            inBlock++;
+            CHECK(datum.EpochMS() == want.EpochMS() && datum.lat == want.lat && datum.lon == want.lon
+                  && datum.elevDM == want.elevDM && datum.gpsFix == want.gpsFix,
+                  "fix %u decoded as %02u-%02u-%02u %u %d,%d,%d fix %u", n - 1,
+                  datum.year, datum.month, datum.day, datum.TimeOfDayMS(), datum.lat, datum.lon, datum.elevDM, datum.gpsFix);
+        }
+
+        CHECK(inBlock > 0, "block %u decoded nothing", (unsigned)(&block - blocks.data()));
+        CHECK(!decoder.GetErrors(), "%u errors in a clean block", decoder.GetErrors());
+    }
+
+    CHECK(n == count, "%u of %u fixes came back", n, count);
+
+    //a damaged keyframe costs only the fixes up to the next one (deltas carry no check)
+    std::vector<uint8_t> damaged = blocks[1];
+    damaged[5] ^= 0x5a;
+
+    GPSTrackDecoder decoder(damaged.data(), damaged.size());
+    GPSDatum datum(0);
+    uint32_t decoded = 0;
+    while(decoder.Next(datum)) decoded++;
+
+    GPSTrackDecoder clean(blocks[1].data(), blocks[1].size());
+    uint32_t total = 0;
+    while(clean.Next(datum)) total++;
+
+    CHECK(decoded > 0 && decoded < total, "damaged block gave %u of %u fixes", decoded, total);
+    CHECK(decoder.GetErrors() > 0, "damage went unnoticed");
+}
+
+/*
+ * track store: bounds, order, and how far the kept track strays from the fixes
+ */
+template <uint16_t N> static void CheckStore(const std::vector<GPSDatum>& fixes, uint32_t tolerance, bool fills)
+{
+    GPSTrackStore<N> store(tolerance);
+    uint32_t lastTolerance = tolerance;
+    uint16_t compactions = 0;
+
+    for(const GPSDatum& datum : fixes)
+    {
+        store.Add(datum);
+
+        uint16_t count = store.Count();
+        CHECK(count >= 1 && count <= N, "store of %u holds %u points", N, count);
+
+        const GPSTrackPoint& tip = store[count - 1];
+        CHECK(tip.lat == datum.lat && tip.lon == datum.lon, "the latest fix isn't the last point");
+
+        if(store.GetTolerance() != lastTolerance)
+        {
+            CHECK(store.GetTolerance() > lastTolerance, "tolerance went down");
+            lastTolerance = store.GetTolerance();
+            compactions++;
+        }
+    }
+
+    uint16_t count = store.Count();
+    for(uint16_t i = 1; i < count; i++)
+        CHECK(store[i].time > store[i - 1].time, "points %u and %u out of order", i - 1, i);
+
+    CHECK(!fills || compactions > 0, "store of %u never compacted for %u fixes", N, (unsigned)fixes.size());
+
+    //every fix is within GetMaxDeviation() of the segment that spans its time
+    int32_t lonScale = GPSTrackLonScale(store[0].lat);
+    uint32_t dayOffset = 0, lastTime = 0, worst = 0;
+    uint16_t segment = 0;
+    for(size_t i = 0; i < fixes.size(); i++)
+    {
+        GPSTrackPoint p;
+        uint32_t time = fixes[i].TimeOfDayMS();
+        if(i && time + 43200000UL < lastTime) dayOffset += 86400000UL;
+        lastTime = time;
+
+        p.time = time + dayOffset;
+        p.lat = fixes[i].lat;
+        p.lon = fixes[i].lon;
+
+        while(segment + 2 < count && store[segment + 1].time <= p.time) segment++;
+        uint32_t deviation = GPSTrackDeviation(store[segment], store[segment + 1], p, lonScale);
+        if(deviation > worst) worst = deviation;
+    }
+
+    CHECK(worst <= store.GetMaxDeviation(), "store of %u: a fix is %u DMM off the track; bound %u",
+          N, worst, store.GetMaxDeviation());
+    CHECK(store.GetTolerance() <= store.GetMaxDeviation(), "store of %u: tolerance %u over the bound %u",
+          N, store.GetTolerance(), store.GetMaxDeviation());
+
+    //Find() and GetRange() agree with a scan
+    GPSTrackPoint range[N];
+    for(uint16_t k = 0; k < 50; k++)
+    {
+        uint32_t from = store[0].time + Random(store[count - 1].time - store[0].time + 1);
+        uint32_t to = from + Random(600000);
+
+        uint16_t first = 0;
+        while(first < count && store[first].time < from) first++;
+        CHECK(store.Find(from) == first, "Find(%u) gave %u, not %u", from, store.Find(from), first);
+
+        uint16_t n = store.GetRange(from, to, range, N), want = 0;
+        for(uint16_t i = first; i < count && store[i].time <= to; i++, want++)
+            CHECK(want < n && range[want].time == store[i].time, "GetRange() missed point %u", i);
+        CHECK(n == want, "GetRange() gave %u points, not %u", n, want);
+    }
+
+    store.Clear();
+    CHECK(store.Count() == 0, "Clear() left %u points", store.Count());
+    CHECK(store.GetTolerance() == tolerance && store.GetMaxDeviation() == tolerance,
+          "after Clear(), tolerance %u and bound %u, not %u", store.GetTolerance(), store.GetMaxDeviation(), tolerance);
+}
+
+static void CheckTrackStore(void)
+{
+    //a walk: straight runs at a steady pace, with turns, and the midnight in MakeTrack()
+    std::vector<GPSDatum> fixes = MakeTrack(1);
+    GPSDatum datum = fixes[0];
+    int32_t dLat = 40, dLon = 0;
+    for(uint32_t i = 0; i < 20000; i++)
+    {
+        if(!Random(120))
+        {
+            dLat = (int32_t)Random(121) - 60;
+            dLon = (int32_t)Random(161) - 80;
+        }
+
+        datum.SetEpochMS(datum.EpochMS() + 1000);
+        datum.lat += dLat + (int32_t)Random(7) - 3;
+        datum.lon += dLon + (int32_t)Random(7) - 3;
+        fixes.push_back(datum);
+    }
+
+    CheckStore<8>(fixes, 10, true);
+    CheckStore<64>(fixes, 10, true);
+    CheckStore<256>(fixes, 10, true);
+    CheckStore<4096>(fixes, 10, false);
+
+    std::vector<GPSDatum> few(fixes.begin(), fixes.begin() + 3);
+    CheckStore<8>(few, 10, false);
+}
+
+/*
+ * fences: the grid index finds exactly the polygons a test of every polygon does
+ */
+static bool Crosses(const GPSFencePoint* v, uint16_t n, int32_t lat, int32_t lon, bool& close) //the same test in floating point
+{
+    bool inside = false;
+    for(uint16_t i = 0, j = n - 1; i < n; j = i++)
+    {
+        const GPSFencePoint& a = v[j];
+        const GPSFencePoint& b = v[i];
+        if((a.lat > lat) == (b.lat > lat)) continue;
+
+        double x = a.lon + (double)(lat - a.lat) * (b.lon - a.lon) / (b.lat - a.lat);
+        if(fabs(x - lon) < 0.01) close = true; //on the edge: either answer will do
+        if(lon < x) inside = !inside;
+    }
+
+    return inside;
+}
+
+static void CheckFenceGrid(uint16_t count, uint16_t rows, uint16_t cols)
+{
+    //star-ish polygons, concave and overlapping, in a 2 x 2 km square
+    std::vector<GPSFencePoint> vertices;
+    std::vector<uint16_t> polygons(1, 0);
+    for(uint16_t p = 0; p < count; p++)
+    {
+        int32_t lat = 25326000 + (int32_t)Random(10000), lon = -43080000 + (int32_t)Random(13000);
+        uint32_t radius = 20 + Random(3000), n = 3 + Random(12);
+        for(uint32_t i = 0; i < n; i++)
+        {
+            double r = i % 2 ? radius * (20 + Random(80)) / 100.0 : radius, a = 2 * M_PI * i / n;
+            GPSFencePoint v = {lat + (int32_t)(r * sin(a)), lon + (int32_t)(r * cos(a) / 0.9)};
+            vertices.push_back(v);
+        }
+
+        polygons.push_back(vertices.size());
+    }
+
+    GPSFenceSet set = {vertices.data(), polygons.data(), count};
+    std::vector<uint16_t> cells(rows * cols + 1), entries(GPSFenceIndex(set, rows, cols, cells.data(), nullptr, 0));
+    CHECK(!set.entries, "an index was built with no room for it");
+    CHECK(GPSFenceIndex(set, rows, cols, cells.data(), entries.data(), entries.size()) == entries.size() && set.entries,
+          "the index didn't fit in the room it asked for");
+
+    GPSGeofence fence(set);
+    uint16_t found[GPS_FENCE_INSIDE];
+    uint32_t insideCount = 0;
+    for(uint32_t k = 0; k < 20000; k++)
+    {
+        //around and beyond the square, and often on a vertex's parallel
+        int32_t lat = 25326000 - 4000 + (int32_t)Random(18000), lon = -43080000 - 4000 + (int32_t)Random(21000);
+        if(!Random(4)) lat = vertices[Random(vertices.size())].lat;
+
+        std::vector<uint16_t> want;
+        for(uint16_t p = 0; p < count; p++)
+        {
+            bool contains = GPSFenceContains(set, p, lat, lon), close = false;
+            bool crosses = Crosses(vertices.data() + polygons[p], polygons[p + 1] - polygons[p], lat, lon, close);
+            CHECK(close || contains == crosses, "polygon %u %s (%d, %d)", p, contains ? "holds" : "misses", lat, lon);
+            if(contains) want.push_back(p);
+        }
+
+        uint16_t n = fence.Locate(lat, lon, found, GPS_FENCE_INSIDE);
+        CHECK(n == want.size(), "%ux%u grid: %u polygons at (%d, %d), not %u", rows, cols, n, lat, lon, (unsigned)want.size());
+        for(uint16_t i = 0; i < n && i < want.size() && i < GPS_FENCE_INSIDE; i++)
+            CHECK(found[i] == want[i], "%ux%u grid: found polygon %u, not %u", rows, cols, found[i], want[i]);
+
+        insideCount += n > 0;
+    }
+
+    CHECK(insideCount > count * 10, "only %u points were in a polygon", insideCount);
+}
+
+static void CheckFences(void)
+{
+    CheckFenceGrid(40, 1, 1);
+    CheckFenceGrid(40, 16, 16);
+    CheckFenceGrid(200, 7, 31);
+    CheckFenceGrid(1, 3, 3);
+}
+
+/*
+ * geodesy: the bounds in gps_geo.h's table, against the same formulas in double precision,
+ * at any latitude -- a quarter of the pairs start within a degree of a pole
+ */
+static const double GEO_RADIUS = 6371008.8, RADIANS_PER_DMM = M_PI / 108000000;
+
+static double Uniform(void) {return Random(1UL << 24) / 16777216.0;}
+
+static double Haversine(double lat1, double lon1, double lat2, double lon2) //DMM in, m out
+{
+    double phi1 = lat1 * RADIANS_PER_DMM, phi2 = lat2 * RADIANS_PER_DMM, dLambda = (lon2 - lon1) * RADIANS_PER_DMM;
+    double a = pow(sin((phi2 - phi1) / 2), 2) + cos(phi1) * cos(phi2) * pow(sin(dLambda / 2), 2);
+    return 2 * GEO_RADIUS * asin(sqrt(fmin(a, 1)));
+}
+
+static double Bearing(double lat1, double lon1, double lat2, double lon2) //radians
+{
+    double phi1 = lat1 * RADIANS_PER_DMM, phi2 = lat2 * RADIANS_PER_DMM, dLambda = (lon2 - lon1) * RADIANS_PER_DMM;
+    return atan2(sin(dLambda) * cos(phi2), cos(phi1) * sin(phi2) - sin(phi1) * cos(phi2) * cos(dLambda));
+}
+
+static void Destination(double lat, double lon, double theta, double distance, double& lat2, double& lon2) //DMM
+/*
+ * with the longitude as atan2(sin(theta)sin(delta), cos(phi1)cos(delta) - sin(phi1)sin(delta)cos(theta)):
+ * the textbook form has a factor of cos(phi1) on both sides, which leaves nothing at a pole
+ */
+{
+    double phi1 = lat * RADIANS_PER_DMM, delta = distance / GEO_RADIUS;
+    double phi2 = asin(sin(phi1) * cos(delta) + cos(phi1) * sin(delta) * cos(theta));
+    double dLambda = atan2(sin(theta) * sin(delta), cos(phi1) * cos(delta) - sin(phi1) * sin(delta) * cos(theta));
+    lat2 = phi2 / RADIANS_PER_DMM;
+    lon2 = remainder(lon + dLambda / RADIANS_PER_DMM, GEO_DMM_PER_CIRCLE);
+}
+
+static void CheckGeo(void)
+{
+    for(uint32_t k = 0; k < 1000000; k++)
+    {
+        uint32_t angle = Random(1UL << 24) << 8 | Random(256);
+        double radians = angle * (2 * M_PI / 4294967296.0);
+        CHECK(fabs(GeoSin(angle) / 1073741824.0 - sin(radians)) < 3e-9, "GeoSin(%u) is %d", angle, GeoSin(angle));
+        CHECK(fabs(GeoCos(angle) / 1073741824.0 - cos(radians)) < 3e-9, "GeoCos(%u) is %d", angle, GeoCos(angle));
+    }
+
+    for(uint32_t k = 0; k < 400000; k++)
+    {
+        //1 m to 10000 km, evenly over the decades, in any direction
+        double distance = pow(10, 7 * Uniform()), theta = 2 * M_PI * Uniform();
+        double degrees = k % 4 ? 180 * Uniform() - 90 : (90 - pow(10, -4 * Uniform())) * (Random(2) ? 1 : -1);
+        int32_t lat1 = lround(degrees * 600000), lon1 = lround((360 * Uniform() - 180) * 600000);
+
+        double lat, lon;
+        Destination(lat1, lon1, theta, distance, lat, lon);
+        int32_t lat2 = lround(lat), lon2 = lround(lon);
+        double h = Haversine(lat1, lon1, lat2, lon2);
+
+        //results are rounded to whole metres and centidegrees, and the bounds are on top of that
+        uint32_t d = GeoDistance(lat1, lon1, lat2, lon2);
+        CHECK(fabs(d - h) < 0.5 + 0.07, "GeoDistance(%d, %d, %d, %d) is %u, not %.2f", lat1, lon1, lat2, lon2, d, h);
+
+        if(h <= 10000 && abs(lat1) < 42000000 && abs(lat2) < 42000000)
+        {
+            uint32_t fast = GeoDistanceFast(lat1, lon1, lat2, lon2);
+            CHECK(fabs(fast - h) < 0.5 + 0.02 + 1e-4 * h, "GeoDistanceFast(%d, %d, %d, %d) is %u, not %.2f", lat1, lon1, lat2, lon2, fast, h);
+        }
+
+        if(h >= 10)
+        {
+            uint16_t cd = GeoBearing(lat1, lon1, lat2, lon2);
+            double error = fabs(remainder(cd / 100.0 - Bearing(lat1, lon1, lat2, lon2) * 180 / M_PI, 360));
+            CHECK(error < 0.005 + (h >= 100 ? 0.01 : 0.1), "GeoBearing(%d, %d, %d, %d) is %u, off by %.4f degrees",
+                  lat1, lon1, lat2, lon2, cd, error);
+        }
+
+        uint16_t bearingCD = Random(36000);
+        uint32_t meters = lround(distance);
+        Destination(lat1, lon1, bearingCD * M_PI / 18000, meters, lat, lon);
+        int32_t destLat, destLon;
+        GeoDestination(lat1, lon1, bearingCD, meters, destLat, destLon);
+        double miss = Haversine(destLat, destLon, lat, lon);
+        CHECK(miss < 0.2, "GeoDestination(%d, %d, %u, %u) is (%d, %d), %.2f m out", lat1, lon1, bearingCD, meters, destLat, destLon, miss);
+
+        //a third point, about as far off the line as along it
+        int32_t lat3 = lat1 + (int32_t)((2 * Uniform() - 1) * distance * 5), lon3 = lon1 + (int32_t)((2 * Uniform() - 1) * distance * 5);
+        if(h > 0 && abs(lat3) <= 54000000)
+        {
+            double delta13 = Haversine(lat1, lon1, lat3, lon3) / GEO_RADIUS;
+            double dTheta = Bearing(lat1, lon1, lat3, lon3) - Bearing(lat1, lon1, lat2, lon2);
+            double want = asin(sin(delta13) * sin(dTheta)) * GEO_RADIUS;
+            int32_t xt = GeoCrossTrack(lat1, lon1, lat2, lon2, lat3, lon3);
+            CHECK(fabs(want) > 5000000 || fabs(xt - want) < 0.5 + 0.1, "GeoCrossTrack(%d, %d, %d, %d, %d, %d) is %d, not %.2f",
+                  lat1, lon1, lat2, lon2, lat3, lon3, xt, want);
+        }
+    }
+
+    //a short hop across a meridian, 0.0063 degrees from the pole
+    CHECK(GeoDistance(53998513, 107037335, 53994713, -18283428) == 1228, "the hop near the pole is %u m",
+          GeoDistance(53998513, 107037335, 53994713, -18283428));
+}
+
+/*
+ * SiRF framing: every good frame comes back out of a stream full of noise, false starts
+ * and damaged frames, and every byte is either in a frame or counted as skipped
+ */
+static uint8_t SiRFByte(void) //random, but heavy on the bytes that mean something to the framer
+{
+    static const uint8_t special[] = {0xA0, 0xA2, 0xB0, 0xB3, 0x00};
+    return Random(4) ? Random(256) : special[Random(sizeof(special))];
+}
+
+static std::vector<uint8_t> SiRFFrame(const std::vector<uint8_t>& payload)
+{
+    std::vector<uint8_t> frame = {0xA0, 0xA2, (uint8_t)(payload.size() >> 8), (uint8_t)payload.size()};
+    uint16_t sum = 0;
+    for(uint8_t b : payload)
+    {
+        frame.push_back(b);
+        sum += b;
+    }
+
+    sum &= 0x7fff;
+    frame.insert(frame.end(), {(uint8_t)(sum >> 8), (uint8_t)sum, 0xB0, 0xB3});
+    return frame;
+}
+
+static void CheckSiRFFramer(void)
+{
+    std::vector<uint8_t> stream;
+    std::vector<std::vector<uint8_t> > sent;
+    uint32_t framed = 0;
+
+    for(uint32_t k = 0; k < 20000; k++)
+    {
+        std::vector<uint8_t> payload(Random(4) ? 1 + Random(SIRF_MAX_PAYLOAD) : 1 + Random(8));
+        for(uint8_t& b : payload) b = SiRFByte();
+        std::vector<uint8_t> frame = SiRFFrame(payload);
+
+        switch(Random(8))
+        {
+            case 0: //noise
+                for(uint32_t i = Random(40); i > 0; i--) stream.push_back(SiRFByte());
+                break;
+            case 1: //a false start, with any length
+                stream.insert(stream.end(), {0xA0, 0xA2, (uint8_t)Random(256), (uint8_t)Random(256)});
+                break;
+            case 2: //a frame cut short
+                stream.insert(stream.end(), frame.begin(), frame.begin() + Random(frame.size()));
+                break;
+            case 3: //a frame with a byte changed
+                frame[Random(frame.size())] ^= 1 + Random(255);
+                stream.insert(stream.end(), frame.begin(), frame.end());
+                break;
+            default: //a good frame
+                stream.insert(stream.end(), frame.begin(), frame.end());
+                sent.push_back(payload);
+                framed += frame.size();
+        }
+    }
+
+    //enough quiet to run out any false frame still holding good ones, so nothing is left half done
+    stream.insert(stream.end(), 4 * (SIRF_MAX_PAYLOAD + 8), 0);
+
+    SiRFFramer framer;
+    uint32_t received = 0, lost = 0;
+    auto Handle = [&](MESSAGE_STATE state)
+    {
+        if(state >= LENGTH_ERROR)
+            CHECK(!framer.GetMessage().Length(), "a failed frame left a message view of %u bytes", framer.GetMessage().Length());
+
+        if(state != COMPLETE) return;
+
+        GPSMessage message = framer.GetMessage();
+        //a good frame may come back late, but never out of order
+        while(received < sent.size() && (message.Length() != sent[received].size()
+              || memcmp(message.payload, sent[received].data(), message.Length()))) {received++; lost++;}
+
+        CHECK(received < sent.size(), "a %u-byte frame that wasn't sent came out", message.Length());
+        received++;
+    };
+
+    for(uint8_t b : stream)
+    {
+        while(framer.Replaying()) Handle(framer.Replay());
+        Handle(framer.AddByte(b));
+    }
+
+    while(framer.Replaying()) Handle(framer.Replay());
+
+    CHECK(!lost, "%u of %u good frames were lost", lost, (unsigned)sent.size());
+    CHECK(received == sent.size(), "%u of %u good frames came out", received, (unsigned)sent.size());
+    CHECK(framer.GetSkippedBytes() == stream.size() - framed, "%u bytes skipped; %u weren't in good frames",
+          framer.GetSkippedBytes(), (unsigned)(stream.size() - framed));
+}
+
+static void CheckSiRFStamps(void) //frames rebuilt from replayed bytes keep the time their A0 came in
+{
+    std::vector<uint8_t> stream;
+    std::vector<uint32_t> starts; //of the good frames, in bytes into the stream
+
+    for(uint32_t k = 0; k < 5000; k++)
+    {
+        std::vector<uint8_t> payload(1 + Random(Random(2) ? SIRF_MAX_PAYLOAD : 40));
+        for(uint8_t& b : payload) b = Random(256);
+        std::vector<uint8_t> frame = SiRFFrame(payload);
+
+        switch(Random(4))
+        {
+            case 0: //cut short, so it swallows what comes next
+                stream.insert(stream.end(), frame.begin(), frame.begin() + 4 + Random(frame.size() - 4));
+                break;
+            case 1:
+                frame[4 + Random(frame.size() - 4)] ^= 1 + Random(255);
+                stream.insert(stream.end(), frame.begin(), frame.end());
+                break;
+            default:
+                starts.push_back(stream.size());
+                stream.insert(stream.end(), frame.begin(), frame.end());
+        }
+    }
+
+    stream.insert(stream.end(), 4 * (SIRF_MAX_PAYLOAD + 8), 0);
+
+    //a byte every 20 us, so a replay happens well after its bytes came in
+    SiRFFramer framer;
+    uint32_t received = 0;
+    auto Handle = [&](MESSAGE_STATE state)
+    {
+        if(state != COMPLETE || received == starts.size()) return;
+
+        uint32_t want = 1000 + starts[received++] * 20;
+        CHECK(framer.StartMicros() == want, "frame %u stamped %u, but its A0 came in at %u", received - 1, framer.StartMicros(), want);
+    };
+
+    for(size_t i = 0; i < stream.size(); i++)
+    {
+        HostSetMicros(1000 + i * 20);
+        while(framer.Replaying()) Handle(framer.Replay());
+        Handle(framer.AddByte(stream[i]));
+    }
+
+    while(framer.Replaying()) Handle(framer.Replay());
+
+    CHECK(received == starts.size(), "%u of %u good frames came out", received, (unsigned)starts.size());
+}
+
+/*
+ * calendar: civil dates, Unix time and GPS weeks against the C library, day by day
+ */
+static void CheckTime(void)
+{
+    for(int32_t days = 0; days <= GPSDaysFromCivil(2105, 12, 31); days++)
+    {
+        time_t t = (time_t)days * 86400;
+        struct tm want;
+        gmtime_r(&t, &want);
+
+        uint16_t year;
+        uint8_t month, day;
+        GPSCivilFromDays(days, year, month, day);
+        CHECK(year == want.tm_year + 1900 && month == want.tm_mon + 1 && day == want.tm_mday,
+              "day %d is %u-%02u-%02u, not %d-%02d-%02d", days, year, month, day, want.tm_year + 1900, want.tm_mon + 1, want.tm_mday);
+        CHECK(GPSDaysFromCivil(year, month, day) == days, "%u-%02u-%02u isn't day %d", year, month, day, days);
+        CHECK(GPSDayFromEpochMS((uint64_t)days * GPS_MS_PER_DAY + Random(GPS_MS_PER_DAY)) == (uint32_t)days, "day %d split wrong", days);
+    }
+
+    //GPSDatum keeps two-digit years, 1980 - 2079
+    const uint64_t from = GPSEpochMS(1980, 1, 1, 0), to = GPSEpochMS(2080, 1, 1, 0);
+    for(uint32_t k = 0; k < 200000; k++)
+    {
+        uint64_t ms = from + ((uint64_t)Random(1 << 20) << 22 | Random(1 << 22)) % (to - from);
+
+        GPSDatum datum(0);
+        datum.SetEpochMS(ms);
+        CHECK(datum.HasDate() && datum.EpochMS() == ms, "%llu came back as %llu", (unsigned long long)ms, (unsigned long long)datum.EpochMS());
+
+        time_t t = ms / 1000;
+        struct tm want;
+        gmtime_r(&t, &want);
+        CHECK(datum.hour == want.tm_hour && datum.minute == want.tm_min && datum.second == want.tm_sec && datum.msec == ms % 1000,
+              "%llu is %02u:%02u:%02u.%03u", (unsigned long long)ms, datum.hour, datum.minute, datum.second, datum.msec);
+
+        char iso[32], isoWant[32];
+        strftime(isoWant, sizeof(isoWant), "%Y-%m-%dT%H:%M:%S", &want);
+        sprintf(isoWant + strlen(isoWant), ".%03uZ", (unsigned)(ms % 1000));
+        CHECK(datum.FormatISOTime(iso, sizeof(iso)) && !strcmp(iso, isoWant), "%llu is %s, not %s", (unsigned long long)ms, iso, isoWant);
+
+        //a GGA (time of day only) dated by a reference up to 12 hours either side
+        GPSDatum gga(0);
+        gga.SetTimeOfDayMS(datum.TimeOfDayMS());
+        uint64_t reference = ms - 43199000 + Random(86398000);
+        CHECK(!gga.HasDate() && gga.EpochMS() == 0, "an undated reading has an epoch");
+        CHECK(gga.EpochMS(reference) == ms, "%llu, dated by %llu, came out %llu",
+              (unsigned long long)ms, (unsigned long long)reference, (unsigned long long)gga.EpochMS(reference));
+
+        if(ms < GPSEpochMSFromWeek(0, 0)) continue; //before GPS time
+
+        uint16_t week;
+        uint32_t tow;
+        GPSWeekFromEpochMS(ms, week, tow);
+        CHECK(tow < GPS_MS_PER_WEEK && GPSEpochMSFromWeek(week, tow) == ms, "%llu is week %u, %u ms", (unsigned long long)ms, week, tow);
+
+        uint16_t near = week + Random(1023) - 511;
+        CHECK(GPSFullWeek(week & 1023, near) == week, "week %u (%u) near %u came out %u", week, week & 1023, near, GPSFullWeek(week & 1023, near));
+    }
+
+    //GPS weeks start on a Sunday, 18 leap seconds ahead of UTC since 2017
+    uint16_t week;
+    uint32_t tow;
+    GPSWeekFromEpochMS(GPSEpochMS(2017, 1, 1, 0), week, tow);
+    CHECK(week == 1930 && tow == 18000, "2017-01-01 is week %u, %u ms", week, tow);
+    CHECK(GPSEpochMSFromWeek(0, 0, 0) == GPS_EPOCH_UNIX * 1000ULL, "week 0 doesn't start at the GPS epoch");
+}
+
+/*
+ * tokenizer: the fields are what splitting the sentence at its commas gives
+ */
+static void CheckTokenizer(void)
+{
+    const char chars[] = "GPA0123456789.-NSEWM$ ";
+    for(uint32_t k = 0; k < 100000; k++)
+    {
+        //mostly sentence-sized, some over the field limit, a few over the 254-byte limit
+        uint32_t count = Random(8) ? 1 + Random(22) : 1 + Random(40);
+        uint32_t width = Random(10) ? 6 : 24;
+        std::vector<std::string> fields;
+        std::string text = Random(8) ? "$" : "";
+        for(uint32_t f = 0; f < count; f++)
+        {
+            std::string field;
+            for(uint32_t n = Random(width); n; n--) field += chars[Random(sizeof(chars) - 1)];
+            if(f == 0 && !text.empty() && !field.empty() && field[0] == '$') field[0] = 'G'; //not a second '$'
+            fields.push_back(field);
+            text += (f ? "," : "") + field;
+        }
+
+        if(Random(4)) text += "*4B";
+
+        std::string seen = text.substr(0, 254);
+        std::vector<std::string> want(1);
+        for(size_t i = seen[0] == '$' ? 1 : 0; i < seen.size() && seen[i] != '*'; i++)
+        {
+            if(seen[i] != ',') want.back() += seen[i];
+            else if(want.size() < NMEA_MAX_FIELDS) want.push_back("");
+            else break;
+        }
+
+        NMEATokenizer tokens(text.c_str(), text.size());
+        CHECK(tokens.FieldCount() == want.size(), "%u fields in \"%s\", not %u", tokens.FieldCount(), text.c_str(), (unsigned)want.size());
+        for(uint8_t i = 0; i < want.size() && i < tokens.FieldCount(); i++)
+            CHECK(tokens[i].ToString() == String(want[i].c_str()), "field %u of \"%s\" is \"%s\"", i, text.c_str(), tokens[i].ToString().c_str());
+        CHECK(tokens[tokens.FieldCount()].IsEmpty() && tokens[255].IsEmpty(), "a field past the end of \"%s\"", text.c_str());
+    }
+
+    NMEATokenizer empty("", 0);
+    CHECK(empty.FieldCount() == 1 && empty[0].IsEmpty(), "an empty line has %u fields", empty.FieldCount());
+}
+
+/*
+ * numbers: ToFixed() and ConvertToDMM() against the digits, whatever their count
+ */
+static std::string Digits(uint32_t count)
+{
+    std::string digits;
+    for(uint32_t i = 0; i < count; i++) digits += '0' + Random(10);
+    return digits;
+}
+
+static long Scaled(const std::string& digits, bool negative) //the digits as a long, clamped as ToFixed() does
+{
+    size_t first = digits.find_first_not_of('0');
+    std::string significant = first == std::string::npos ? "0" : digits.substr(first);
+    std::string limit = std::to_string(LONG_MAX);
+    bool over = significant.size() > limit.size() || (significant.size() == limit.size() && significant > limit);
+
+    long value = over ? LONG_MAX : strtol(significant.c_str(), nullptr, 10);
+    return negative ? -value : value;
+}
+
+static void CheckNumbers(void)
+{
+    for(uint32_t k = 0; k < 200000; k++)
+    {
+        //[sign]digits[.digits][junk], with up to 25 digits either side so that some overflow
+        uint8_t sign = Random(3), decimals = Random(8);
+        std::string whole = Digits(Random(4) ? Random(10) : Random(26)), fraction = Digits(Random(4) ? Random(7) : Random(26));
+        bool point = Random(4);
+
+        std::string text = std::string(sign == 1 ? "-" : sign == 2 ? "+" : "") + whole + (point ? "." + fraction : "");
+        if(!Random(4)) text += "x,*N"[Random(4)] + Digits(Random(3));
+
+        std::string digits = whole + (point ? fraction : "").substr(0, decimals);
+        digits.append(whole.size() + decimals - digits.size(), '0');
+
+        long value = NMEAField(text.c_str(), text.size()).ToFixed(decimals);
+        CHECK(value == Scaled(digits, sign == 1), "\"%s\" to %u decimals is %ld, not %ld", text.c_str(), decimals, value, Scaled(digits, sign == 1));
+    }
+
+    CHECK(NMEAField("", 0).ToFixed(2) == 0 && NMEAField("-", 1).ToFixed(2) == 0 && NMEAField(".5", 2).ToFixed(2) == 50, "empty digits");
+
+    //[d]ddmm.mmm to .mmmmmm, as receivers send them
+    for(uint32_t k = 0; k < 200000; k++)
+    {
+        bool lon = Random(2);
+        uint32_t degrees = Random(lon ? 180 : 90), minutes = Random(60), decimals = 3 + Random(4);
+        std::string fraction = Digits(decimals);
+
+        char text[24];
+        sprintf(text, lon ? "%03u%02u.%s" : "%02u%02u.%s", degrees, minutes, fraction.c_str());
+        long want = degrees * 600000L + minutes * 10000L + atol((fraction + "000").substr(0, 4).c_str());
+
+        long dmm = GPSDatum::ConvertToDMM(NMEAField(text, strlen(text)));
+        CHECK(dmm == want, "%s is %ld DMM, not %ld", text, dmm, want);
+    }
+
+    CHECK(!GPSDatum::ConvertToDMM(NMEAField("123.4567", 8)) && !GPSDatum::ConvertToDMM(NMEAField("4807", 4)), "a short field made a coordinate");
+}
+
+/*
+ * checksum: every value verifies, whichever case its digits are in, and nothing else does
+ */
+static std::string Sentence(const char* body) //"$body*hh\r\n"
+{
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X\r\n", GPS::CalcChecksum(body, strlen(body)));
+    return std::string("$") + body + tail;
+}
+
+static NMEA_LINE_STATE Feed(NMEALineBuffer& line, const std::string& text) //the state after the last character
+{
+    NMEA_LINE_STATE state = LINE_WAITING;
+    for(char c : text) state = line.AddChar(c);
+    return state;
+}
+
+static void CheckChecksums(void)
+{
+    const char chars[] = "GPNRMCA0123456789.,-NSEW";
+    bool seen[256] = {};
+    NMEALineBuffer line;
+    char tail[8];
+    for(uint32_t k = 0; k < 20000; k++)
+    {
+        std::string body = "GP";
+        for(uint32_t n = 3 + Random(60); n; n--) body += chars[Random(sizeof(chars) - 1)];
+        uint8_t checksum = GPS::CalcChecksum(body.c_str(), body.size());
+        seen[checksum] = true;
+
+        for(const char* format : {"*%02X\r\n", "*%02x\r\n", "*%02X\n"})
+        {
+            snprintf(tail, sizeof(tail), format, checksum);
+            std::string text = "$" + body + tail;
+            NMEA_LINE_STATE state = Feed(line, text);
+            CHECK(state == LINE_COMPLETE && text.compare(0, line.Length(), line.GetLine()) == 0 && line.Length() == body.size() + 4,
+                  "\"%s\" is state %u, \"%s\"", text.c_str(), state, line.GetLine());
+            CHECK(GPS::VerifyChecksum(line.GetLine(), line.Length()), "\"%s\" didn't verify", line.GetLine());
+        }
+
+        //one bit or more off, one digit (a checksum printed without its leading zero), three, or none
+        snprintf(tail, sizeof(tail), "*%02X\r\n", checksum ^ (1 + Random(255)));
+        CHECK(Feed(line, "$" + body + tail) == LINE_CHECKSUM_ERROR && !GPS::VerifyChecksum(line.GetLine(), line.Length()),
+              "\"%s\" passed", line.GetLine());
+        snprintf(tail, sizeof(tail), checksum < 0x10 && Random(2) ? "*%X\r\n" : "*%03X\r\n", checksum);
+        CHECK(Feed(line, "$" + body + tail) == LINE_CHECKSUM_ERROR, "\"%s\" passed", line.GetLine());
+        CHECK(Feed(line, "$" + body + "\r\n") == LINE_CHECKSUM_ERROR, "\"%s\" passed without a checksum", line.GetLine());
+    }
+
+    uint16_t values = 0;
+    for(bool value : seen) values += value;
+    CHECK(values == 128, "only %u checksums came up", values); //ASCII never sets the top bit
+
+    //end to end: GGAs whose checksums are 0x00 - 0x0F, each with its own latitude, all parsed
+    std::string stream;
+    std::vector<long> lats;
+    for(uint32_t k = 0; k < 1000000 && lats.size() < 16; k++)
+    {
+        char body[96];
+        uint32_t minutes = Random(600000);
+        sprintf(body, "GPGGA,%02u%02u%02u.000,42%02u.%04u,N,07148.3777,W,1,08,%s,%u.%u,M,%s,,", Random(24), Random(60), Random(60),
+                minutes / 10000, minutes % 10000, Random(2) ? "0.9" : "1", Random(2000), Random(10), Random(2) ? "46.9,M" : ","); //lengths vary, so all bits do
+        if(GPS::CalcChecksum(body, strlen(body)) == lats.size())
+        {
+            stream += Sentence(body);
+            lats.push_back(42 * 600000L + minutes);
+        }
+    }
+
+    CHECK(lats.size() == 16, "only %u low checksums came up", (unsigned)lats.size());
+
+    FileSerial serial(7);
+    serial.Load((const uint8_t*)stream.data(), stream.size());
+    GPS_MTK3339 gps(&serial);
+    std::vector<long> parsed;
+    uint16_t errors = 0;
+    gps.OnSentence(GGA, [](const GPSDatum& datum, void* context) {((std::vector<long>*)context)->push_back(datum.lat);}, &parsed);
+    gps.OnError([](uint8_t, void* context) {(*(uint16_t*)context)++;}, &errors);
+    while(serial.NextChunk()) gps.CheckSerial();
+
+    CHECK(parsed == lats && !errors, "%u of %u low-checksum GGAs parsed, %u errors", (unsigned)parsed.size(), (unsigned)lats.size(), errors);
+}
+
+/*
+ * sentence: the fields of each type we parse, from any talker
+ */
+static GPSDatum Parse(GPS& gps, const char* body)
+{
+    std::string text = Sentence(body);
+    return gps.ParseNMEA(text.c_str(), text.size() - 2); //without the "\r\n"
+}
+
+static std::string Coordinate(uint32_t dmm, bool lon) //[d]ddmm.mmmm
+{
+    char text[16];
+    sprintf(text, lon ? "%03u%02u.%04u" : "%02u%02u.%04u", dmm / 600000, dmm / 10000 % 60, dmm % 10000);
+    return text;
+}
+
+static void CheckSentences(void)
+{
+    const char* talkers[] = {"GP", "GN", "GL", "GA", "GB"};
+    FileSerial serial;
+    GPS_MTK3339 gps(&serial);
+    char body[160];
+    for(uint32_t k = 0; k < 20000; k++)
+    {
+        const char* talker = talkers[Random(5)];
+        uint32_t hour = Random(24), minute = Random(60), second = Random(60), msec = Random(1000);
+        uint32_t time = ((hour * 60 + minute) * 60 + second) * 1000 + msec;
+        uint32_t lat = Random(90) * 600000 + Random(600000), lon = Random(180) * 600000 + Random(600000);
+        bool south = Random(2), west = Random(2);
+        int32_t wantLat = south ? -(int32_t)lat : lat, wantLon = west ? -(int32_t)lon : lon;
+
+        uint32_t fix = 1 + Random(8), sats = Random(25), hdop = Random(10000);
+        int32_t elev = (int32_t)Random(33000) - 500; //elevDM is 16 bits
+        sprintf(body, "%sGGA,%02u%02u%02u.%03u,%s,%c,%s,%c,%u,%02u,%u.%02u,%s%u.%u,M,46.9,M,,", talker, hour, minute, second, msec,
+                Coordinate(lat, false).c_str(), south ? 'S' : 'N', Coordinate(lon, true).c_str(), west ? 'W' : 'E', fix, sats,
+                hdop / 100, hdop % 100, elev < 0 ? "-" : "", abs(elev) / 10, abs(elev) % 10);
+        GPSDatum gga = Parse(gps, body);
+        CHECK(gga.source == GGA && gga.gpsFix == fix && gga.TimeOfDayMS() == time && gga.lat == wantLat && gga.lon == wantLon
+              && gga.satsUsed == sats && gga.hdop == hdop && gga.elevDM == elev, "%s: source %u, fix %u, %u ms, %d, %d, %u sats, %u, %d dm",
+              body, gga.source, gga.gpsFix, gga.TimeOfDayMS(), gga.lat, gga.lon, gga.satsUsed, gga.hdop, gga.elevDM);
+
+        uint32_t knots = Random(20000), course = Random(36000), day = 1 + Random(31), month = 1 + Random(12), year = Random(100);
+        sprintf(body, "%sRMC,%02u%02u%02u.%03u,A,%s,%c,%s,%c,%u.%02u,%u.%02u,%02u%02u%02u,,,A", talker, hour, minute, second, msec,
+                Coordinate(lat, false).c_str(), south ? 'S' : 'N', Coordinate(lon, true).c_str(), west ? 'W' : 'E',
+                knots / 100, knots % 100, course / 100, course % 100, day, month, year);
+        GPSDatum rmc = Parse(gps, body);
+        CHECK(rmc.source == RMC && rmc.TimeOfDayMS() == time && rmc.lat == wantLat && rmc.lon == wantLon && rmc.speedCMS == knots * 1852 / 3600
+              && rmc.courseCD == course && rmc.day == day && rmc.month == month && rmc.year == year,
+              "%s: source %u, %u ms, %d, %d, %u cm/s, %u cd, %02u-%02u-%02u", body, rmc.source, rmc.TimeOfDayMS(), rmc.lat, rmc.lon,
+              rmc.speedCMS, rmc.courseCD, rmc.year, rmc.month, rmc.day);
+
+        //GSA has twelve satellite fields, any of them empty, before PDOP, HDOP and VDOP
+        uint32_t mode = 1 + Random(3);
+        std::string satellites;
+        for(uint8_t i = 0; i < 12; i++) satellites += Random(2) ? std::to_string(1 + Random(32)) + "," : ",";
+        sprintf(body, "%sGSA,A,%u,%s%u.%02u,%u.%02u,%u.%02u", talker, mode, satellites.c_str(), Random(50), Random(100),
+                hdop / 100, hdop % 100, Random(50), Random(100));
+        GPSDatum gsa = Parse(gps, body);
+        CHECK(gsa.source == GSA && gsa.fixMode == mode && gsa.hdop == hdop, "%s: source %u, mode %u, HDOP %u", body, gsa.source, gsa.fixMode, gsa.hdop);
+
+        uint32_t inView = Random(40);
+        sprintf(body, "%sGSV,3,%u,%02u,%02u,%02u,%03u,%02u", talker, 1 + Random(3), inView, 1 + Random(32), Random(90), Random(360), Random(50));
+        GPSDatum gsv = Parse(gps, body);
+        CHECK(gsv.source == GSV && gsv.satsInView == inView, "%s: source %u, %u in view", body, gsv.source, gsv.satsInView);
+
+        //VTG's speed is taken in km/h; mode N means the data aren't valid
+        uint32_t kmh = Random(100000);
+        char vtgMode = "ADEN"[Random(4)];
+        sprintf(body, "%sVTG,%u.%02u,T,,M,%u.%02u,N,%u.%02u,K,%c", talker, course / 100, course % 100, Random(500), Random(100),
+                kmh / 100, kmh % 100, vtgMode);
+        GPSDatum vtg = Parse(gps, body);
+        if(vtgMode == 'N') CHECK(vtg.source == 0, "%s was taken", body);
+        else CHECK(vtg.source == VTG && vtg.courseCD == course && vtg.speedCMS == kmh * 10 / 36, "%s: source %u, %u cd, %u cm/s",
+                   body, vtg.source, vtg.courseCD, vtg.speedCMS);
+
+        uint32_t fullYear = 1980 + Random(100);
+        sprintf(body, "%sZDA,%02u%02u%02u.%02u,%02u,%02u,%04u,00,00", talker, hour, minute, second, msec / 10, day, month, fullYear);
+        GPSDatum zda = Parse(gps, body);
+        CHECK(zda.source == ZDA && zda.TimeOfDayMS() == time - msec % 10 && zda.day == day && zda.month == month && zda.year == fullYear % 100,
+              "%s: source %u, %u ms, %02u-%02u-%02u", body, zda.source, zda.TimeOfDayMS(), zda.year, zda.month, zda.day);
+
+        //no fix, no data, or not a type we parse
+        const char* nothing[] = {"GGA,120000.000,4216.4707,N,07148.3777,W,0,00,,,M,,M,,", "RMC,120000.000,V,,,,,,,180520,,,N",
+                                 "GLL,4216.4707,N,07148.3777,W,120000.000,A,A", "TXT,01,01,02,ANTENNA OK", "GG", "GGAX,1"};
+        sprintf(body, "%s%s", talker, nothing[Random(6)]);
+        CHECK(Parse(gps, body).source == 0, "%s was taken", body);
+    }
+
+    const char* proprietary[] = {"PMTK001,314,3", "PSRF156,1", "PGRMZ,93,f,3"};
+    for(const char* body : proprietary) CHECK(Parse(gps, body).source == 0, "%s was taken", body);
+}
+
+/*
+ * epoch: sentences merged by time, and epochs let go when complete, late, or crowded out
+ */
+static GPSDatum Reading(uint8_t source, uint32_t time, uint32_t timestamp) //with a value for each field the source carries
+{
+    GPSDatum reading(timestamp);
+    reading.source = source;
+    reading.SetTimeOfDayMS(time);
+    reading.satsUsed = 1 + Random(24);
+    reading.speedCMS = Random(10000);
+    reading.day = 1 + Random(28);
+    reading.month = 1 + Random(12);
+    reading.fixMode = 1 + Random(3);
+    reading.satsInView = Random(40);
+    return reading;
+}
+
+static bool Holds(const GPSDatum& epoch, const GPSDatum& reading) //the epoch has reading's fields
+{
+    uint8_t source = reading.source;
+    return (!(source & GGA) || epoch.satsUsed == reading.satsUsed) && (!(source & RMC) || (epoch.speedCMS == reading.speedCMS
+           && epoch.day == reading.day && epoch.month == reading.month)) && (!(source & GSA) || epoch.fixMode == reading.fixMode)
+           && (!(source & GSV) || epoch.satsInView == reading.satsInView) && (!GPSDatum::IsTimed(source) || epoch.TimeOfDayMS() == reading.TimeOfDayMS());
+}
+
+static void CheckEpochs(void)
+{
+    for(uint32_t k = 0; k < 20000; k++)
+    {
+        uint32_t now = Random(2) ? Random(1UL << 24) : 0xFFFFFFFF - Random(3000); //some across the wrap of millis()
+        uint32_t time = Random(86000000), period = 100 * (1 + Random(10));
+
+        //two epochs interleaved, each with an untimed sentence after its GGA; RMCs in either order
+        GPSEpochAssembler epochs;
+        GPSDatum gga1 = Reading(GGA, time, now), gsa = Reading(GSA, 0, now), gga2 = Reading(GGA, time + period, now + 1);
+        GPSDatum gsv = Reading(GSV, 0, now + 1), rmc1 = Reading(RMC, time, now + 2), rmc2 = Reading(RMC, time + period, now + 2);
+        epochs.Add(Reading(VTG, 0, now)); //nothing open to join
+        epochs.Add(gga1);
+        epochs.Add(gsa);
+        epochs.Add(gga2);
+        epochs.Add(gsv);
+        CHECK(!epochs.Check(now + 2), "an epoch went out before its RMC");
+
+        bool swapped = Random(2);
+        for(uint8_t i = 0; i < 2; i++)
+        {
+            bool first = (i == 0) != swapped;
+            epochs.Add(first ? rmc1 : rmc2);
+            uint8_t mask = epochs.Check(now + 2);
+            const GPSDatum& epoch = epochs.GetEpoch();
+            uint8_t want = first ? GGA | GSA | RMC : GGA | GSV | RMC;
+            CHECK(mask == want && epoch.source == want && Holds(epoch, first ? gga1 : gga2) && Holds(epoch, first ? rmc1 : rmc2)
+                  && Holds(epoch, first ? gsa : gsv), "epoch %u of 2 (%s) went out as 0x%x at %u ms", i + 1, swapped ? "swapped" : "in order",
+                  mask, epoch.TimeOfDayMS());
+        }
+
+        CHECK(!epochs.Check(now + 100000), "an epoch was left over");
+
+        //an epoch that never completes goes out when it's been open for the timeout, and not before
+        uint16_t timeout = 100 + Random(3000);
+        epochs.SetTimeout(timeout);
+        epochs.Add(Reading(GGA, time, now));
+        CHECK(!epochs.Check(now + timeout - 1), "a GGA went out before %u ms", timeout);
+        CHECK(epochs.Check(now + timeout) == GGA && epochs.GetEpoch().TimeOfDayMS() == time, "a GGA didn't go out after %u ms", timeout);
+
+        //with every slot open, a new epoch crowds out the one that opened first
+        GPSDatum ggas[GPS_EPOCH_SLOTS + 1];
+        for(uint8_t i = 0; i <= GPS_EPOCH_SLOTS; i++)
+        {
+            ggas[i] = Reading(GGA, time + (Random(2) ? 1 : -1) * (int32_t)(i * period), now + i);
+            epochs.Add(ggas[i]);
+        }
+
+        uint8_t mask = epochs.Check(now + GPS_EPOCH_SLOTS);
+        CHECK(mask == GGA && Holds(epochs.GetEpoch(), ggas[0]), "0x%x at %u ms went out, not the first GGA", mask, epochs.GetEpoch().TimeOfDayMS());
+        CHECK(!epochs.Check(now + GPS_EPOCH_SLOTS), "an epoch went out after the eviction");
+
+        for(uint8_t j = GPS_EPOCH_SLOTS; j; j--)
+        {
+            uint8_t i = 1 + (j + k) % GPS_EPOCH_SLOTS;
+            GPSDatum rmc = Reading(RMC, ggas[i].TimeOfDayMS(), now + GPS_EPOCH_SLOTS);
+            epochs.Add(rmc);
+            mask = epochs.Check(now + GPS_EPOCH_SLOTS);
+            CHECK(mask == (GGA | RMC) && Holds(epochs.GetEpoch(), ggas[i]) && Holds(epochs.GetEpoch(), rmc), "GGA %u went out as 0x%x", i, mask);
+        }
+
+        //more sentences required
+        epochs.SetRequired(GGA | RMC | GSA);
+        epochs.Add(Reading(GGA, time, now));
+        epochs.Add(Reading(RMC, time, now));
+        CHECK(!epochs.Check(now), "an epoch went out without its GSA");
+        epochs.Add(Reading(GSA, 0, now));
+        CHECK(epochs.Check(now) == (GGA | RMC | GSA), "an epoch didn't go out with its GSA");
+    }
+
+    //through a GPS, on the simulated clock: GGA alone waits for the timeout, unless it's all that's turned on
+    std::string gga = Sentence("GPGGA,120000.000,4216.4707,N,07148.3777,W,1,08,0.9,150.1,M,46.9,M,,");
+    for(uint8_t ggaOnly = 0; ggaOnly < 2; ggaOnly++)
+    {
+        HostSetMicros(1000000 + Random(1000000));
+        FileSerial serial(gga.size());
+        serial.Load((const uint8_t*)gga.data(), gga.size());
+        GPS_MTK3339 gps(&serial);
+        uint16_t emitted = 0;
+        gps.OnEpoch([](const GPSDatum&, void* context) {(*(uint16_t*)context)++;}, &emitted);
+        if(ggaOnly) CHECK(gps.SetActiveNMEAStrings(GGA), "PMTK314 wasn't queued");
+
+        serial.NextChunk();
+        gps.CheckSerial();
+        CHECK(emitted == ggaOnly, "GGA%s: %u epochs at once", ggaOnly ? " only" : "", emitted);
+
+        HostAdvanceMicros((GPS_EPOCH_TIMEOUT - 1) * 1000UL);
+        gps.CheckSerial();
+        CHECK(emitted == ggaOnly, "GGA%s: %u epochs before the timeout", ggaOnly ? " only" : "", emitted);
+        HostAdvanceMicros(1000);
+        gps.CheckSerial();
+        CHECK(emitted == 1, "GGA%s: %u epochs after the timeout", ggaOnly ? " only" : "", emitted);
+    }
+}
+
+/*
+ * filter: SetSentenceFilter() drops the types it isn't given at the header, unchecked
+ */
+static void CheckFilter(void)
+{
+    struct Type {uint8_t flag; const char* body;}; //body without its talker
+    const Type types[] =
+    {
+        {GGA, "GGA,120000.000,4216.4707,N,07148.3777,W,1,08,0.9,150.1,M,46.9,M,,"},
+        {RMC, "RMC,120000.000,A,4216.4707,N,07148.3777,W,0.13,309.62,120598,,,A"},
+        {GSA, "GSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1"},
+        {GSV, "GSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00"},
+        {VTG, "VTG,309.62,T,,M,0.13,N,0.2,K,A"},
+        {ZDA, "ZDA,120000.00,12,05,1998,00,00"},
+        {0, "GLL,4216.4707,N,07148.3777,W,120000.000,A,A"},
+        {0, "TXT,01,01,02,ANTENNA OK"},
+        {PROPRIETARY, "PMTK010,002"},
+        {PROPRIETARY, "PSRF156,1"},
+    };
+    const char* talkers[] = {"GP", "GN", "GL"};
+
+    for(uint32_t k = 0; k < 2000; k++)
+    {
+        uint8_t filter = Random(4) ? 1 + Random(0x7F) : 0;
+        std::string stream;
+        std::vector<uint8_t> want;
+        uint16_t filtered = 0, corrupt = 0;
+        for(uint32_t n = 1 + Random(60); n; n--)
+        {
+            const Type& type = types[Random(sizeof(types) / sizeof(types[0]))];
+            std::string body = type.flag == PROPRIETARY ? type.body : std::string(talkers[Random(3)]) + type.body;
+            std::string text = Sentence(body.c_str());
+            bool bad = !Random(8);
+            if(bad) text[text.size() - 3] ^= 0x01; //a wrong checksum: only a line that gets past the filter is checked
+
+            bool passes = !filter || (type.flag & filter);
+            filtered += !passes;
+            corrupt += passes && bad;
+            if(passes && !bad && type.flag && type.flag != PROPRIETARY) want.push_back(type.flag);
+            stream += text;
+        }
+
+        FileSerial serial(1 + Random(100));
+        serial.Load((const uint8_t*)stream.data(), stream.size());
+        GPS_MTK3339 gps(&serial);
+        gps.SetSentenceFilter(filter);
+        std::vector<uint8_t> seen;
+        uint16_t errors = 0;
+        gps.OnSentence(0x7F, [](const GPSDatum& datum, void* context) {((std::vector<uint8_t>*)context)->push_back(datum.source);}, &seen);
+        gps.OnError([](uint8_t, void* context) {(*(uint16_t*)context)++;}, &errors);
+        while(serial.NextChunk()) gps.CheckSerial();
+
+        CHECK(seen == want && gps.GetFilteredCount() == filtered && errors == corrupt, "filter 0x%02x: %u of %u sentences, %u of %u filtered, %u of %u errors",
+              filter, (unsigned)seen.size(), (unsigned)want.size(), gps.GetFilteredCount(), filtered, errors, corrupt);
+    }
+
+    //a PMTK001 gets past a filter without PROPRIETARY while a PMTK command waits for it, and only then
+    std::string stream = Sentence("PMTK001,220,3") + Sentence("GPGGA,120000.000,4216.4707,N,07148.3777,W,1,08,0.9,150.1,M,46.9,M,,");
+    for(uint8_t waiting = 0; waiting < 2; waiting++)
+    {
+        FileSerial serial(stream.size());
+        serial.Load((const uint8_t*)stream.data(), stream.size());
+        GPS_MTK3339 gps(&serial);
+        gps.SetSentenceFilter(GGA);
+        uint8_t ticket = waiting ? gps.QueueNMEA("PMTK220,1000") : 0;
+        gps.PollCommands();
+
+        serial.NextChunk();
+        gps.CheckSerial();
+        gps.PollCommands();
+        CHECK(gps.GetFilteredCount() == !waiting && (!waiting || gps.GetCommandStatus(ticket) == GPS_COMMAND_DONE),
+              "PMTK001 %s a command: %u filtered, status %u", waiting ? "with" : "without", gps.GetFilteredCount(), gps.GetCommandStatus(ticket));
+    }
+}
+
+/*
+ * bring-up: probing, switching rates and confirming, against a receiver played on the host
+ */
+class SimReceiver : public HardwareSerial
+/*
+ * Talks once a second at rxBaud -- a GGA, or a MID 4 frame in binary -- and the port
+ * hears noise if it's open at any other rate. Takes PMTK251, PSRF100 and MID 134 as a
+ * rate change, unless obeys is false. Whatever the library sends is kept in 'sent'.
+ */
+{
+public:
+    uint32_t rxBaud;
+    bool binary;
+    bool obeys = true;
+
+    std::string pending; //on its way to the library
+    std::vector<uint8_t> sent;
+    uint32_t next = 0;
+
+    SimReceiver(uint32_t rate, bool bin) : rxBaud(rate), binary(bin) {}
+
+    void Tick(void)
+    {
+        if(millis() < next) return;
+        next = millis() + 1000;
+
+        if(baud != rxBaud)
+        {
+            for(uint8_t i = 0; i < 40; i++) pending += (char)Random(256);
+            return;
+        }
+
+        if(!binary) pending += Sentence("GPGGA,120000.000,4216.4707,N,07148.3777,W,1,08,0.9,150.1,M,46.9,M,,");
+        else
+        {
+            std::vector<uint8_t> frame = SiRFFrame(std::vector<uint8_t>(20, 4));
+            pending.append(frame.begin(), frame.end());
+        }
+    }
+
+    int available(void) {return pending.size();}
+    int read(void)
+    {
+        if(pending.empty()) return -1;
+
+        uint8_t c = pending[0];
+        pending.erase(0, 1);
+        return c;
+    }
+
+    size_t write(uint8_t b)
+    {
+        sent.push_back(b);
+        if(!obeys || baud != rxBaud) return 1; //it can't make out what we say at the wrong rate
+
+        std::string text(sent.begin(), sent.end());
+        size_t at;
+        if(b == '\n' && (at = text.rfind("PMTK251,")) != std::string::npos) rxBaud = atol(text.c_str() + at + 8);
+        else if(b == '\n' && (at = text.rfind("PSRF100,1,")) != std::string::npos) rxBaud = atol(text.c_str() + at + 10);
+        else if(b == 0xB3 && sent.size() >= 17 && sent[sent.size() - 17] == 0xA0 && sent[sent.size() - 13] == 0x86)
+        {
+            const uint8_t* rate = &sent[sent.size() - 12];
+            rxBaud = (uint32_t)rate[0] << 24 | (uint32_t)rate[1] << 16 | rate[2] << 8 | rate[3];
+        }
+
+        if(b == '\n' || b == 0xB3) sent.clear();
+        return 1;
+    }
+};
+
+struct InitLog
+{
+    uint8_t states = 0; //a bit for each GPS_INIT_STATE passed through
+    uint32_t opened = 0; //the last rate OnBaud() was told of
+};
+
+template <class Receiver> static uint8_t BringUp(SimReceiver& sim, Receiver& gps, InitLog& log, uint32_t target)
+{
+    gps.OnInit([](uint8_t state, uint8_t, void* context) {((InitLog*)context)->states |= 1 << state;}, &log);
+    gps.OnBaud([](uint32_t baud, void* context) {((InitLog*)context)->opened = baud;}, &log);
+    gps.SetBaudTarget(target);
+    gps.Begin(1500, 1);
+
+    for(uint32_t ms = 0; ms < 60000 && gps.GetInitState() < GPS_INIT_READY; ms++)
+    {
+        HostAdvanceMicros(1000);
+        sim.Tick();
+        gps.Dispatch();
+    }
+
+    return gps.GetInitState();
+}
+
+static void CheckInit(void)
+{
+    const uint8_t switched = 1 << GPS_INIT_SWITCH | 1 << GPS_INIT_CONFIRM | 1 << GPS_INIT_READY;
+
+    for(uint8_t binary = 0; binary < 2; binary++) //PSRF100, then MID 134
+    {
+        SimReceiver sim(4800, binary);
+        GPS_EM506 gps(&sim, binary ? GPS_BINARY : GPS_NMEA);
+        InitLog log;
+
+        uint8_t state = BringUp(sim, gps, log, 57600);
+        CHECK(state == GPS_INIT_READY && (log.states & switched) == switched, "EM506 (%s) ended in state %u, by 0x%x",
+              binary ? "binary" : "NMEA", state, log.states);
+        CHECK(gps.GetBaud() == 57600 && sim.rxBaud == 57600 && log.opened == 57600, "EM506 (%s) is at %u, the receiver at %u, the port at %u",
+              binary ? "binary" : "NMEA", gps.GetBaud(), sim.rxBaud, log.opened);
+    }
+
+    //found at another rate, then switched
+    SimReceiver mtk(38400, false);
+    GPS_MTK3339 fast(&mtk);
+    InitLog log;
+    CHECK(BringUp(mtk, fast, log, 115200) == GPS_INIT_READY && fast.GetBaud() == 115200 && mtk.rxBaud == 115200,
+          "MTK3339 at 38400 came up at %u, the receiver at %u", fast.GetBaud(), mtk.rxBaud);
+
+    //a switch that doesn't take goes back to the rate that worked
+    SimReceiver stubborn(9600, false);
+    stubborn.obeys = false;
+    GPS_MTK3339 slow(&stubborn);
+    log = InitLog();
+    CHECK(BringUp(stubborn, slow, log, 115200) == GPS_INIT_READY && slow.GetBaud() == 9600 && log.opened == 9600
+          && (log.states & 1 << GPS_INIT_CONFIRM), "a refused switch left us at %u, the port at %u", slow.GetBaud(), log.opened);
+
+    //no target, and the rate is right: the port is opened once, by Init(), which doesn't wait
+    SimReceiver plain(9600, false);
+    GPS_MTK3339 once(&plain);
+    uint8_t opens = 0;
+    once.OnBaud([](uint32_t, void* context) {(*(uint8_t*)context)++;}, &opens);
+    CHECK(once.Init() == 1 && once.GetInitState() < GPS_INIT_READY, "Init() waited, to state %u", once.GetInitState());
+    for(uint32_t ms = 0; ms < 5000 && once.GetInitState() < GPS_INIT_READY; ms++)
+    {
+        HostAdvanceMicros(1000);
+        plain.Tick();
+        once.Dispatch();
+    }
+
+    CHECK(once.GetInitState() == GPS_INIT_READY && opens == 1, "state %u after opening the port %u times", once.GetInitState(), opens);
+
+    //nobody there: it gives up, and the queued command is dropped, not left waiting
+    SimReceiver silent(1, false);
+    GPS_MTK3339 alone(&silent);
+    log = InitLog();
+    uint8_t dropped = 0;
+    alone.OnCommand([](uint8_t, uint8_t status, void* context) {*(uint8_t*)context += status == GPS_COMMAND_DROPPED;}, &dropped);
+    alone.SetReportPeriod(200);
+    CHECK(BringUp(silent, alone, log, 0) == GPS_INIT_FAILED && dropped == 1, "a silent receiver: state %u, %u dropped",
+          alone.GetInitState(), dropped);
+}
+
+/*
+ * commands: what the queue takes, and how acknowledgements finish what it sent
+ */
+static void CheckCommands(void)
+{
+    //bodies are measured before they're narrowed to the queue's 8-bit length
+    GPSCommandQueue queue;
+    std::string body(GPS_COMMAND_LENGTH, 'A');
+    CHECK(queue.AddNMEA(body.c_str()) && queue.Pending() == 1, "a %u-byte body didn't fit", GPS_COMMAND_LENGTH);
+    for(size_t length : {GPS_COMMAND_LENGTH + 1, 256 + 4, 512 + GPS_COMMAND_LENGTH})
+    {
+        body.assign(length, 'A');
+        CHECK(!queue.AddNMEA(body.c_str()) && queue.Pending() == 1, "a %u-byte body was queued", (unsigned)length);
+    }
+
+    //a receiver that ignores the first few tries, then acknowledges (PMTK001, or MID 11 or 12) the command it's sent
+    for(uint32_t k = 0; k < 2000; k++)
+    {
+        HostSetMicros(1000000 + Random(1000000));
+        bool binary = Random(2);
+        uint16_t timeout = 100 + Random(2000);
+        uint8_t retries = Random(4), silent = Random(retries + 2), flag = Random(2) ? 3 : Random(3); //flag 3 is accepted
+        bool stray = Random(2); //an acknowledgement of something else comes first
+
+        FileSerial serial(256);
+        GPS_EM506 gps(&serial, binary ? GPS_BINARY : GPS_NMEA);
+        gps.SetCommandTimeout(timeout, retries);
+        std::vector<uint8_t> finished; //ticket, status, ...
+        gps.OnCommand([](uint8_t ticket, uint8_t status, void* context)
+                      {((std::vector<uint8_t>*)context)->insert(((std::vector<uint8_t>*)context)->end(), {ticket, status});}, &finished);
+
+        char text[32];
+        uint16_t id = binary ? 128 + Random(40) : 200 + Random(400);
+        uint8_t payload[] = {(uint8_t)id, (uint8_t)Random(128), (uint8_t)Random(128)};
+        sprintf(text, "PMTK%u,%u", id, Random(1000));
+        uint8_t ticket = binary ? gps.QueueBinary(payload, 3) : gps.QueueNMEA(text);
+        uint8_t after = binary ? gps.QueueBinary(payload, 3, false) : gps.QueueNMEA("PSRF103,00,00,01,01"); //not acknowledged
+
+        std::vector<uint32_t> sentAt;
+        for(uint32_t ms = 0; ms < 20000 && gps.GetCommandStatus(after) != GPS_COMMAND_DONE; ms += 10, HostAdvanceMicros(10000))
+        {
+            gps.CheckSerial();
+
+            uint16_t sends = 0; //NMEA lines or SiRF frames
+            for(size_t i = 0; i < serial.sent.size(); i++)
+                sends += binary ? (i && serial.sent[i - 1] == 0xB0 && serial.sent[i] == 0xB3) : serial.sent[i] == '\n';
+
+            while(sentAt.size() < sends)
+            {
+                sentAt.push_back(millis());
+                if(sentAt.size() != 1u + silent || silent > retries) continue;
+
+                std::string reply;
+                for(uint8_t i = !stray; i < 2; i++)
+                {
+                    uint16_t acked = i ? id : id + 1;
+                    uint8_t answer = i ? flag : flag == 3 ? 1 : 3; //the stray one says the opposite
+                    if(binary)
+                    {
+                        std::vector<uint8_t> frame = SiRFFrame({(uint8_t)(answer == 3 ? 11 : 12), (uint8_t)acked});
+                        reply.append(frame.begin(), frame.end());
+                    }
+                    else
+                    {
+                        sprintf(text, "PMTK001,%u,%u", acked, answer);
+                        reply += Sentence(text);
+                    }
+                }
+
+                serial.Load((const uint8_t*)reply.data(), reply.size());
+                serial.NextChunk();
+            }
+        }
+
+        uint8_t status = silent > retries ? GPS_COMMAND_TIMEOUT : flag == 3 ? GPS_COMMAND_DONE : GPS_COMMAND_REJECTED;
+        uint8_t tries = silent > retries ? retries + 1 : silent + 1;
+        std::vector<uint8_t> want = {ticket, status, after, GPS_COMMAND_DONE};
+        CHECK(finished == want && gps.GetCommandStatus(ticket) == status && sentAt.size() == tries + 1u,
+              "%s, %u retries, %u ignored, flag %u: status %u, sent %u times", binary ? "SiRF" : "PMTK", retries, silent, flag,
+              gps.GetCommandStatus(ticket), (unsigned)sentAt.size());
+
+        //each resend comes when the acknowledgement is overdue, and the next command once this one is finished
+        for(size_t i = 1; i < sentAt.size() && i < tries; i++)
+            CHECK(sentAt[i] - sentAt[i - 1] >= timeout && sentAt[i] - sentAt[i - 1] <= timeout + 10u, "try %u came %u ms after the one before, not %u",
+                  (unsigned)i + 1, sentAt[i] - sentAt[i - 1], timeout);
+        if(sentAt.size() == tries + 1u && silent > retries)
+            CHECK(sentAt[tries] - sentAt[tries - 1] >= timeout, "the next command went out %u ms after the last try", sentAt[tries] - sentAt[tries - 1]);
+    }
+}
+
+struct CheckGroup
+{
+    const char* name;
+    void (*run)(void);
+};
+
+static const CheckGroup groups[] =
+{
+    {"time", CheckTime},
+    {"tokenizer", CheckTokenizer},
+    {"number", CheckNumbers},
+    {"checksum", CheckChecksums},
+    {"sentence", CheckSentences},
+    {"epoch", CheckEpochs},
+    {"filter", CheckFilter},
+    {"init", CheckInit},
+    {"command", CheckCommands},
+    {"track", CheckTrackCodec},
+    {"store", CheckTrackStore},
+    {"fence", CheckFences},
+    {"geo", CheckGeo},
+    {"sirf", CheckSiRFFramer},
+    {"stamp", CheckSiRFStamps},
+};
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    std::vector<const char*> names;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-v")) verbose = true;
+        else names.push_back(argv[i]);
+    }
+
+    for(const CheckGroup& group : groups)
+    {
+        bool wanted = names.empty();
+        for(const char* name : names) wanted |= !strcmp(name, group.name);
+        if(!wanted) continue;
+
+        uint32_t before = checks, failedBefore = failures;
+        seed = 12345; //each group's inputs are the same whichever groups run
+        group.run();
+        if(verbose || failures != failedBefore)
+            fprintf(stderr, "%-8s %u checks, %u failed\n", group.name, checks - before, failures - failedBefore);
+    }
+
+    printf("%u checks, %u failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Builds the grid index for a set of geofences (see gps_fence.h) and writes it all out as
+ * const arrays, so the index lives in flash instead of being built at startup.
+ *
+ *   gps_fencegen [-g rows cols] [-n name] fences.txt > fences.h
+ *   gps_fencegen -t capture.nmea [-g rows cols] fences.txt
+ *
+ *   -g  grid size (default 16 x 16)
+ *   -n  name of the GPSFenceSet (default fences)
+ *   -t  instead, run a NMEA log through GPS_EM506 and a GPSGeofence, and print each
+ *       polygon entered or left
+ *
+ * fences.txt has a vertex per line, "lat,lon" in decimal degrees; a blank line ends a
+ * polygon, and lines starting with '#' are skipped.
+ */
+
+#include <gps_fence.h>
+#include "FileSerial.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+static bool LoadFences(const char* name, std::vector<GPSFencePoint>& vertices, std::vector<uint16_t>& polygons)
+{
+    FILE* in = fopen(name, "r");
+    if(!in) return false;
+
+    polygons.push_back(0);
+
+    char line[128];
+    while(fgets(line, sizeof(line), in))
+    {
+        double lat, lon;
+        if(line[0] == '#') continue;
+        if(sscanf(line, "%lf , %lf", &lat, &lon) == 2)
+        {
+            GPSFencePoint point = {(int32_t)lround(lat * 600000), (int32_t)lround(lon * 600000)};
+            vertices.push_back(point);
+        }
+
+        else if(vertices.size() > polygons.back()) polygons.push_back(vertices.size()); //blank: end of a polygon
+    }
+
+    if(vertices.size() > polygons.back()) polygons.push_back(vertices.size());
+
+    fclose(in);
+    return true;
+}
+
+static void PrintArray(const char* type, const char* name, const char* suffix, const uint16_t* values, size_t count)
+{
+    printf("static const %s %s%s[] =\n{", type, name, suffix);
+    for(size_t i = 0; i < count; i++) printf("%s%u,", i % 16 ? " " : "\n    ", values[i]);
+    printf("\n};\n\n");
+}
+
+static void OnChange(uint16_t polygon, bool entered, const GPSDatum& datum, void* context)
+{
+    char time[32];
+    datum.FormatISOTime(time, sizeof(time));
+    printf("%s %s %u\n", time, entered ? "enter" : "leave", polygon);
+}
+
+int main(int argc, char** argv)
+{
+    const char* fenceFile = nullptr;
+    const char* logFile = nullptr;
+    const char* name = "fences";
+    uint16_t rows = 16, cols = 16;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-g") && i + 2 < argc) {rows = atoi(argv[++i]); cols = atoi(argv[++i]);}
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc) name = argv[++i];
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc) logFile = argv[++i];
+        else if(argv[i][0] != '-') fenceFile = argv[i];
+    }
+
+    if(!fenceFile || !rows || !cols)
+    {
+        fprintf(stderr, "usage: %s [-g rows cols] [-n name] fences.txt > fences.h\n"
+                        "       %s -t capture.nmea [-g rows cols] fences.txt\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    std::vector<GPSFencePoint> vertices;
+    std::vector<uint16_t> polygons;
+    if(!LoadFences(fenceFile, vertices, polygons) || polygons.size() < 2)
+    {
+        fprintf(stderr, "no polygons in %s\n", fenceFile);
+        return 1;
+    }
+
+    GPSFenceSet set = {vertices.data(), polygons.data(), (uint16_t)(polygons.size() - 1)};
+
+    std::vector<uint16_t> cells(rows * cols + 1), entries;
+    uint16_t needed = GPSFenceIndex(set, rows, cols, cells.data(), entries.data(), 0);
+    entries.resize(needed);
+    GPSFenceIndex(set, rows, cols, cells.data(), entries.data(), needed);
+
+    if(logFile)
+    {
+        FileSerial serial;
+        if(!serial.Load(logFile))
+        {
+            fprintf(stderr, "cannot read %s\n", logFile);
+            return 1;
+        }
+
+        GPSGeofence fence(set);
+        fence.OnChange(OnChange);
+
+        GPS_EM506 gps(&serial);
+        gps.OnEpoch(GPSFenceDatum, &fence);
+        while(!serial.Done())
+        {
+            serial.NextChunk();
+            gps.Dispatch();
+        }
+
+        fprintf(stderr, "%u polygons, %u entries in %u x %u cells\n", set.polygonCount, needed, rows, cols);
+        return 0;
+    }
+
+    printf("//generated by gps_fencegen from %s: %u polygons, %u x %u cells\n\n", fenceFile, set.polygonCount, rows, cols);
+    printf("#include <gps_fence.h>\n\n");
+
+    printf("static const GPSFencePoint %sVertices[] =\n{", name);
+    for(size_t i = 0; i < vertices.size(); i++) printf("%s{%d, %d},", i % 4 ? " " : "\n    ", vertices[i].lat, vertices[i].lon);
+    printf("\n};\n\n");
+
+    PrintArray("uint16_t", name, "Polygons", polygons.data(), polygons.size());
+    PrintArray("uint16_t", name, "Cells", cells.data(), cells.size());
+    PrintArray("uint16_t", name, "Entries", entries.data(), entries.size());
+
+    printf("static const GPSFenceSet %s = {%sVertices, %sPolygons, %u,\n", name, name, name, set.polygonCount);
+    printf("    %d, %d, %u, %u, %u, %u, %sCells, %sEntries};\n", set.lat0, set.lon0, set.cellLat, set.cellLon, rows, cols, name, name);
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Replays a captured NMEA or SiRF binary log through the library and prints what
+ * comes out, followed by throughput numbers.
+ *
+ *   gps_replay [-r em506|jf2] [-b] [-e|-i] [-c chunk] [-n passes] [-q] logfile
+ *
+ *   -r  receiver class to run the log through (default em506)
+ *   -b  the log is SiRF binary; frames are reported instead of datums
+ *   -e  use the event handlers and Dispatch() instead of polling CheckSerial()
+ *   -i  parse "at interrupt level" with Ingest(); epochs are collected in an SPSCQueue
+ *   -c  bytes released to the library per poll (default 64)
+ *   -n  number of passes over the log for timing (default 1)
+ *   -q  quiet: only print the summary
+ */
+
+#include <gps.h>
+#include "FileSerial.h"
+
+#include <chrono>
+#include <string.h>
+
+struct ReplayStats
+{
+    uint32_t polls = 0;
+    uint32_t reports = 0;
+    uint32_t errors = 0;
+    bool print = false; //for the event handlers
+};
+
+static void PrintDatum(const GPSDatum& datum)
+{
+    printf("%02X,%02u/%02u/%02u,%02u:%02u:%02u.%03u,%ld,%ld,%d,%u,%u/%u,%u,%u,%u,%u\n",
+           datum.source,
+           datum.day, datum.month, datum.year,
+           datum.hour, datum.minute, datum.second, datum.msec,
+           (long)datum.lat, (long)datum.lon,
+           datum.elevDM, datum.gpsFix,
+           datum.satsUsed, datum.satsInView, datum.fixMode, datum.hdop,
+           datum.speedCMS, datum.courseCD);
+}
+
+static void ReplayNMEA(GPS& gps, FileSerial& serial, bool print, ReplayStats& stats)
+{
+    while(!serial.Done())
+    {
+        serial.NextChunk();
+        uint8_t result = gps.CheckSerial();
+        stats.polls++;
+
+        if(result & (GGA | RMC | GSA | GSV | VTG | ZDA))
+        {
+            stats.reports++;
+            if(print) PrintDatum(gps.GetReading());
+        }
+    }
+}
+
+static void OnEpoch(const GPSDatum& epoch, void* context)
+{
+    ReplayStats& stats = *(ReplayStats*)context;
+    stats.reports++;
+    if(stats.print) PrintDatum(epoch);
+}
+
+static void OnMessage(const GPSMessage& message, void* context)
+{
+    ReplayStats& stats = *(ReplayStats*)context;
+    if(stats.print) printf("MID %u, %u bytes\n", message.msgID, message.Length());
+}
+
+static void OnError(uint8_t error, void* context)
+{
+    ReplayStats& stats = *(ReplayStats*)context;
+    stats.errors++;
+    if(stats.print) printf("error %u\n", error);
+}
+
+static void ReplayEvents(GPS& gps, FileSerial& serial, bool print, ReplayStats& stats)
+{
+    stats.print = print;
+    while(!serial.Done())
+    {
+        serial.NextChunk();
+        gps.Dispatch();
+        stats.polls++;
+    }
+}
+
+static void ReplayIngest(GPS& gps, FileSerial& serial, bool print, ReplayStats& stats)
+{
+    SPSCQueue<GPSDatum, 16> fixes;
+    gps.OnEpoch(GPSQueueDatum<16>, &fixes);
+
+    while(!serial.Done())
+    {
+        serial.NextChunk();
+        while(serial.available()) gps.Ingest(serial.read()); //what the UART interrupt would do
+
+        GPSDatum fix; //and loop()
+        while(fixes.Pop(fix))
+        {
+            stats.reports++;
+            if(print) PrintDatum(fix);
+        }
+
+        stats.polls++;
+    }
+
+    stats.errors += fixes.GetDropped();
+}
+
+static void ReplayBinary(GPS& gps, FileSerial& serial, bool print, ReplayStats& stats)
+{
+    while(!serial.Done())
+    {
+        serial.NextChunk();
+        uint8_t result;
+        do //CheckSerialBinary returns after each frame, so keep going until the chunk is used up
+        {
+            result = gps.CheckSerialBinary();
+            stats.polls++;
+
+            if(result == COMPLETE)
+            {
+                stats.reports++;
+                if(print)
+                {
+                    GPSMessage message = gps.GetMessage();
+                    printf("MID %u, %u bytes\n", message.msgID, message.Length());
+
+                    GPSDatum datum = gps.ParseSiRF(message);
+                    if(datum.source) PrintDatum(datum);
+                }
+            }
+
+            else if(result >= LENGTH_ERROR)
+            {
+                stats.errors++;
+                if(print) printf("%s\n", result == CHECKSUM_ERROR ? "checksum error" : result == EPILOG_ERROR ? "epilog error" : "length error");
+            }
+        } while(result == COMPLETE || result >= LENGTH_ERROR);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* receiver = "em506";
+    bool binary = false;
+    bool events = false;
+    bool ingest = false;
+    bool quiet = false;
+    size_t chunk = 64;
+    int passes = 1;
+    const char* filename = nullptr;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-r") && i + 1 < argc) receiver = argv[++i];
+        else if(!strcmp(argv[i], "-b")) binary = true;
+        else if(!strcmp(argv[i], "-e")) events = true;
+        else if(!strcmp(argv[i], "-i")) ingest = true;
+        else if(!strcmp(argv[i], "-q")) quiet = true;
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc) chunk = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc) passes = atoi(argv[++i]);
+        else if(argv[i][0] != '-') filename = argv[i];
+        else filename = nullptr, i = argc;
+    }
+
+    if(!filename || passes < 1)
+    {
+        fprintf(stderr, "usage: %s [-r em506|jf2] [-b] [-e|-i] [-c chunk] [-n passes] [-q] logfile\n", argv[0]);
+        return 2;
+    }
+
+    FileSerial serial(chunk);
+    if(!serial.Load(filename))
+    {
+        fprintf(stderr, "cannot read %s\n", filename);
+        return 1;
+    }
+
+    GPS_PROTOCOL protocol = binary ? GPS_BINARY : GPS_NMEA;
+    //both on the stack; neither touches the port until it's used
+    GPS_EM506 em506(&serial, protocol);
+    GPS_JF2 jf2(&serial, protocol);
+
+    GPS* gps = nullptr;
+    if(!strcmp(receiver, "em506")) gps = &em506;
+    else if(!strcmp(receiver, "jf2")) gps = &jf2;
+    else
+    {
+        fprintf(stderr, "unknown receiver '%s'\n", receiver);
+        return 2;
+    }
+
+    ReplayStats stats;
+    if(events)
+    {
+        gps->OnEpoch(OnEpoch, &stats);
+        gps->OnMessage(0, OnMessage, &stats);
+        gps->OnError(OnError, &stats);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for(int pass = 0; pass < passes; pass++)
+    {
+        serial.Rewind();
+        bool print = !quiet && pass == 0;
+        if(ingest) ReplayIngest(*gps, serial, print, stats);
+        else if(events) ReplayEvents(*gps, serial, print, stats);
+        else if(binary) ReplayBinary(*gps, serial, print, stats);
+        else ReplayNMEA(*gps, serial, print, stats);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(binary) fprintf(stderr, "%u bytes skipped while looking for frames\n", gps->GetSkippedBytes());
+    double bytes = (double)serial.Size() * passes;
+
+    fprintf(stderr, "%.0f bytes, %u polls, %u %s, %u errors in %.3f ms\n",
+            bytes, stats.polls, stats.reports, binary ? "frames" : "reports", stats.errors, seconds * 1e3);
+    if(seconds > 0)
+        fprintf(stderr, "%.2f MB/s, %.1f ns/byte, %.0f %s/s\n",
+                bytes / seconds / 1e6, seconds * 1e9 / bytes, stats.reports / seconds, binary ? "frames" : "reports");
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Converts between NMEA logs, binary track logs (see gps_track.h), CSV and GPX.
+ *
+ *   gps_trackconv -e [-c chunk] [-k interval] capture.nmea track.bin
+ *   gps_trackconv [-g] track.bin
+ *
+ *   -e  encode: run the NMEA log through GPS_EM506 and write each epoch to a track log,
+ *       in 512-byte blocks the way an SD logger would; prints the size against CSV
+ *   -c  bytes released to the library per poll (default 64)
+ *   -k  fixes between keyframes (default 60)
+ *   -g  decode to GPX instead of CSV (time,lat,lon,elev,fix)
+ */
+
+#include <gps_track.h>
+#include "FileSerial.h"
+
+#include <string.h>
+
+#define BLOCK_SIZE 512
+
+struct EncodeState
+{
+    GPSTrackEncoder* encoder;
+    FILE* out;
+    uint32_t fixes = 0;
+    uint32_t csvBytes = 0;
+    uint32_t blocks = 0;
+};
+
+static void WriteBlock(EncodeState& state, bool pad)
+{
+    uint16_t length = pad ? state.encoder->Pad() : state.encoder->GetLength();
+    if(!length) return;
+
+    fwrite(state.encoder->GetData(), 1, length, state.out);
+    state.encoder->Clear();
+    state.blocks++;
+}
+
+static void OnEpoch(const GPSDatum& epoch, void* context)
+{
+    EncodeState& state = *(EncodeState*)context;
+    if(!epoch.gpsFix) return;
+
+    char line[64];
+    state.csvBytes += epoch.FormatCSV(line, sizeof(line)) + 2; //println adds \r\n
+    state.fixes++;
+
+    if(!state.encoder->Add(epoch))
+    {
+        WriteBlock(state, true);
+        state.encoder->Add(epoch);
+    }
+}
+
+static int Encode(const char* inName, const char* outName, size_t chunk, uint16_t interval)
+{
+    FileSerial serial(chunk);
+    if(!serial.Load(inName))
+    {
+        fprintf(stderr, "cannot read %s\n", inName);
+        return 1;
+    }
+
+    FILE* out = fopen(outName, "wb");
+    if(!out)
+    {
+        fprintf(stderr, "cannot write %s\n", outName);
+        return 1;
+    }
+
+    uint8_t block[BLOCK_SIZE];
+    GPSTrackEncoder encoder(block, sizeof(block), interval);
+
+    EncodeState state;
+    state.encoder = &encoder;
+    state.out = out;
+
+    GPS_EM506 gps(&serial);
+    gps.OnEpoch(OnEpoch, &state);
+
+    while(!serial.Done())
+    {
+        serial.NextChunk();
+        gps.Dispatch();
+    }
+
+    WriteBlock(state, false); //the last one isn't padded
+    long size = ftell(out);
+    fclose(out);
+
+    fprintf(stderr, "%u fixes: %u bytes as CSV, %ld bytes in %u blocks (%.1fx), %.1f bytes/fix\n",
+            state.fixes, state.csvBytes, size, state.blocks,
+            size ? (double)state.csvBytes / size : 0.0, state.fixes ? (double)size / state.fixes : 0.0);
+
+    return 0;
+}
+
+static int Decode(const char* inName, bool gpx)
+{
+    FileSerial file; //just for loading
+    if(!file.Load(inName))
+    {
+        fprintf(stderr, "cannot read %s\n", inName);
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    while(file.NextChunk()) {}
+    for(int c; (c = file.read()) != -1;) data.push_back(c);
+
+    if(gpx) printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                   "<gpx version=\"1.1\" creator=\"gps_trackconv\" xmlns=\"http://www.topografix.com/GPX/1/1\">\n"
+                   "<trk><trkseg>\n");
+
+    uint32_t fixes = 0;
+    uint16_t errors = 0;
+    for(size_t start = 0; start < data.size(); start += BLOCK_SIZE) //blocks decode on their own
+    {
+        size_t length = data.size() - start < BLOCK_SIZE ? data.size() - start : BLOCK_SIZE;
+        GPSTrackDecoder decoder(data.data() + start, length);
+
+        GPSDatum datum;
+        while(decoder.Next(datum))
+        {
+            char time[32], lat[16], lon[16];
+            datum.FormatISOTime(time, sizeof(time));
+
+            GPSWriter(lat, sizeof(lat)).Degrees(datum.lat).Finish();
+            GPSWriter(lon, sizeof(lon)).Degrees(datum.lon).Finish();
+
+            char elev[12];
+            GPSWriter(elev, sizeof(elev)).Fixed(datum.elevDM, 1).Finish();
+
+            if(gpx) printf("<trkpt lat=\"%s\" lon=\"%s\"><ele>%s</ele><time>%s</time></trkpt>\n", lat, lon, elev, time);
+            else printf("%s,%s,%s,%s,%u\n", time, lat, lon, elev, datum.gpsFix);
+
+            fixes++;
+        }
+
+        errors += decoder.GetErrors();
+    }
+
+    if(gpx) printf("</trkseg></trk>\n</gpx>\n");
+
+    fprintf(stderr, "%u fixes, %u bytes skipped\n", fixes, errors);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool encode = false;
+    bool gpx = false;
+    size_t chunk = 64;
+    uint16_t interval = 60;
+    const char* files[2] = {nullptr, nullptr};
+    int fileCount = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-e")) encode = true;
+        else if(!strcmp(argv[i], "-g")) gpx = true;
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc) chunk = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-k") && i + 1 < argc) interval = atoi(argv[++i]);
+        else if(argv[i][0] != '-' && fileCount < 2) files[fileCount++] = argv[i];
+        else fileCount = -1, i = argc;
+    }
+
+    if(fileCount != (encode ? 2 : 1))
+    {
+        fprintf(stderr, "usage: %s -e [-c chunk] [-k interval] capture.nmea track.bin\n"
+                        "       %s [-g] track.bin\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    return encode ? Encode(files[0], files[1], chunk, interval) : Decode(files[0], gpx);
+}
@@ -5,155 +5,784 @@ String GPSDatum::GetNMEASubstring(const String& str, int commaIndex)
  * grabs the substring of an NMEA string after comma number commaIndex
  */
 {
-  int iComma = 0;
-  for(int i = 0; i < commaIndex; i++)
+  NMEATokenizer fields(str.c_str(), str.length());
+  return fields[commaIndex].ToString();
+}
+
+long GPSDatum::ConvertToDMM(const NMEAField& degStr) // "decimilliminutes": divide be 10000 to get minutes
+/*
+ * [d]ddmm.mmmm, with any number of decimals (extra ones are truncated)
+ */
+{
+  if(degStr.IndexOf('.') < 4) return 0;
+
+  long dddmm = degStr.ToFixed(4); //degrees * 1000000 + minutes * 10000
+  return (dddmm / 1000000) * 600000L + dddmm % 1000000;
+}
+
+int GPSDatum::NMEAtoTime(const NMEAField& timeStr)
+/*
+ * hhmmss[.sss]
+ */
+{
+  if(timeStr.length < 6) return 0;
+
+  long hms = timeStr.ToFixed(3);
+
+  msec = hms % 1000;
+  hms /= 1000;
+  second = hms % 100;
+  hms /= 100;
+  minute = hms % 100;
+  hour = hms / 100;
+
+  return 1;
+}
+
+int GPSDatum::NMEAtoDate(const NMEAField& dateStr)
+/*
+ * ddmmyy
+ */
+{
+  if(dateStr.length != 6) return 0;
+
+  long dmy = dateStr.ToInt();
+
+  year = dmy % 100;
+  month = (dmy / 100) % 100;
+  day = dmy / 10000;
+
+  return 1;
+}
+
+void GPSDatum::SetEpochMS(uint64_t ms)
+{
+  uint32_t days = GPSDayFromEpochMS(ms);
+  SetTimeOfDayMS((uint32_t)ms - days * GPS_MS_PER_DAY); //under 2^32, so the low words will do
+
+  uint16_t fullYear;
+  GPSCivilFromDays(days, fullYear, month, day);
+  year = fullYear % 100;
+}
+
+void GPSDatum::MergeFields(const GPSDatum& newReading)
+{
+  if(newReading.source & GGA)
+  {
+    lat = newReading.lat;
+    lon = newReading.lon;
+    elevDM = newReading.elevDM;
+    gpsFix = newReading.gpsFix;
+    satsUsed = newReading.satsUsed;
+    hdop = newReading.hdop;
+  }
+
+  if(newReading.source & (RMC | ZDA))
+  {
+    year = newReading.year;
+    month = newReading.month;
+    day = newReading.day;
+  }
+
+  if(newReading.source & RMC)
+  {
+    if(!(source & GGA)) //GGA has the same position, plus more
+    {
+      lat = newReading.lat;
+      lon = newReading.lon;
+    }
+  }
+
+  if(newReading.source & (RMC | VTG))
+  {
+    speedCMS = newReading.speedCMS;
+    courseCD = newReading.courseCD;
+  }
+
+  if(newReading.source & GSA)
+  {
+    fixMode = newReading.fixMode;
+    hdop = newReading.hdop;
+  }
+
+  if(newReading.source & GSV) satsInView = newReading.satsInView;
+
+  source |= newReading.source;
+}
+
+void GPSEpochAssembler::Add(const GPSDatum& reading)
+{
+  if(!GPSDatum::IsTimed(reading.source))
+  {
+    if(latest < GPS_EPOCH_SLOTS) slots[latest].MergeFields(reading); //else there's no epoch to put it in
+    return;
+  }
+
+  uint32_t time = reading.TimeOfDayMS();
+  uint8_t free = GPS_EPOCH_SLOTS;
+  uint8_t oldest = 0;
+
+  for(uint8_t i = 0; i < GPS_EPOCH_SLOTS; i++)
+  {
+    if(!slots[i].source)
+    {
+      if(free == GPS_EPOCH_SLOTS) free = i;
+      continue;
+    }
+
+    if(slots[i].TimeOfDayMS() == time)
+    {
+      slots[i].MergeFields(reading);
+      return;
+    }
+
+    if((int32_t)(slots[i].timestamp - slots[oldest].timestamp) < 0 || !slots[oldest].source) oldest = i;
+  }
+
+  if(free == GPS_EPOCH_SLOTS) //all in use: the oldest goes out as it is
+  {
+    Emit(oldest);
+    evicted = true;
+    free = oldest;
+  }
+
+  slots[free] = reading; //starts the clock on the new epoch, too
+  latest = free;
+}
+
+uint8_t GPSEpochAssembler::Check(uint32_t now)
+{
+  if(evicted)
+  {
+    evicted = false;
+    return epoch.source;
+  }
+
+  for(uint8_t i = 0; i < GPS_EPOCH_SLOTS; i++)
   {
-    iComma = str.indexOf(',', iComma + 1);
-    if(iComma == -1) return String("");
+    if(!slots[i].source) continue;
+
+    if((slots[i].source & required) == required || now - slots[i].timestamp >= timeout)
+    {
+      Emit(i);
+      return epoch.source;
+    }
   }
 
-  int iCommaNext = str.indexOf(',', iComma + 1);
-  if(iCommaNext == -1) return String("");
+  return 0;
+}
+
+void GPSEpochAssembler::Reset(void)
+{
+  for(uint8_t i = 0; i < GPS_EPOCH_SLOTS; i++) slots[i].source = 0;
+  latest = GPS_EPOCH_SLOTS;
+  evicted = false;
+}
+
+bool GPS::OnMessage(uint8_t msgID, GPSMessageHandler handler, void* context)
+/*
+ * Registers a handler for a binary message ID; a second call for the same ID replaces
+ * the first. Returns false if the table (GPS_MESSAGE_HANDLERS) is full.
+ */
+{
+    int8_t slot = -1;
+    for(uint8_t i = 0; i < GPS_MESSAGE_HANDLERS; i++)
+    {
+        if(messageHandlers[i].handler && messageHandlers[i].msgID == msgID) {slot = i; break;}
+        if(!messageHandlers[i].handler && slot == -1) slot = i;
+    }
+
+    if(slot == -1) return !handler;
+
+    messageHandlers[slot].handler = handler;
+    messageHandlers[slot].context = context;
+    messageHandlers[slot].msgID = msgID;
+
+    return true;
+}
+
+//what Begin() tries when the receiver isn't heard at the rate it's expected at, and can raise it to
+static const uint32_t gpsBaudRates[] = {4800, 9600, 19200, 38400, 57600, 115200};
+#define GPS_BAUD_RATES (sizeof(gpsBaudRates) / sizeof(gpsBaudRates[0]))
+
+void GPS::Begin(uint16_t timeout, uint8_t retries)
+{
+    initTimeout = timeout;
+    initRetries = retries;
+    initAttempt = 0;
+    probeIndex = 0;
+    switchFailed = false;
+
+    probeBaud = baud;
+    Open(baud);
+
+    if(sysOnPin >= 0) pinMode(sysOnPin, INPUT);
+    if(onOffPin >= 0)
+    {
+        digitalWrite(onOffPin, LOW);
+        pinMode(onOffPin, OUTPUT);
+    }
+
+    heardMark = heardCount;
+    SetInitState(GPS_INIT_START);
+}
+
+uint8_t GPS::PollInit(void)
+/*
+ * One attempt is START (wait for the port, and for the pins to settle) -> WAKE (a pulse
+ * on the on/off input, if there is one) -> WAIT (for SYSTEM_ON) -> PROBE (for a good
+ * sentence or frame, at the expected rate and then at each of the others in turn). A
+ * receiver with SYSTEM_ON skips PROBE unless there's a baud target. If the port or the
+ * receiver isn't up by the timeout (for each rate, when probing), the next attempt
+ * starts over.
+ *
+ * With a baud target, a receiver that's been heard is told to change, and after SWITCH
+ * (the command going out) we change too and CONFIRM by hearing it again. If we don't, we
+ * go back to PROBE at the old rate -- and on through the others, in case the receiver did
+ * change and we just missed it.
+ */
+{
+    uint32_t now = millis();
+
+    switch(initState)
+    {
+        case GPS_INIT_START:
+            if(!*serial) //a USB port, say, that nobody has opened
+            {
+                if(now - initAt >= initTimeout) Retry();
+                break;
+            }
+
+            if(onOffPin >= 0 && now - initAt < GPS_WAKE_SETTLE) break;
+
+            if(sysOnPin >= 0 && digitalRead(sysOnPin) == HIGH) SetInitState(GPS_INIT_WAIT); //already awake; a pulse would turn it off
+            else if(onOffPin >= 0)
+            {
+                digitalWrite(onOffPin, HIGH);
+                SetInitState(GPS_INIT_WAKE);
+            }
+            else
+            {
+                probeIndex = 0;
+                Listen(baud, GPS_INIT_PROBE);
+            }
+            break;
 
-  return str.substring(iComma + 1, iCommaNext);
+        case GPS_INIT_WAKE:
+            if(now - initAt < GPS_WAKE_PULSE) break;
+
+            digitalWrite(onOffPin, LOW);
+            heardMark = heardCount;
+            SetInitState(GPS_INIT_WAIT);
+            break;
+
+        case GPS_INIT_WAIT:
+            if(digitalRead(sysOnPin) == HIGH)
+            {
+                if(!targetBaud) SetInitState(GPS_INIT_READY); //no need to hear it
+                else
+                {
+                    probeIndex = 0;
+                    Listen(baud, GPS_INIT_PROBE);
+                }
+            }
+
+            else if(now - initAt >= initTimeout) Retry();
+            break;
+
+        case GPS_INIT_PROBE:
+            if(HeardSinceMark()) Heard();
+            else if(now - initAt >= initTimeout)
+            {
+                //the next rate, skipping the one we started with
+                while(++probeIndex <= GPS_BAUD_RATES && gpsBaudRates[probeIndex - 1] == baud) {}
+
+                if(probeIndex <= GPS_BAUD_RATES) Listen(gpsBaudRates[probeIndex - 1], GPS_INIT_PROBE);
+                else Retry();
+            }
+            break;
+
+        case GPS_INIT_SWITCH:
+            //the command (under 64 bytes) is out at the old rate, and the receiver has had time to act on it
+            if(now - initAt >= 640000UL / baud + GPS_BAUD_SETTLE) Listen(probeBaud, GPS_INIT_CONFIRM);
+            break;
+
+        case GPS_INIT_CONFIRM:
+            if(HeardSinceMark())
+            {
+                baud = probeBaud;
+                SetInitState(GPS_INIT_READY);
+            }
+
+            else if(now - initAt >= initTimeout)
+            {
+                switchFailed = true;
+                probeIndex = 0;
+                Listen(baud, GPS_INIT_PROBE);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return initState;
+}
+
+void GPS::Heard(void)
+{
+    baud = probeBaud;
+
+    //the fastest rate we know that's within both the target and what the receiver can do
+    uint32_t limit = targetBaud < maxBaud ? targetBaud : maxBaud;
+    uint32_t rate = 0;
+    for(uint8_t i = 0; i < GPS_BAUD_RATES; i++)
+        if(gpsBaudRates[i] <= limit) rate = gpsBaudRates[i];
+
+    if(rate > baud && !switchFailed && SendBaud(rate))
+    {
+        probeBaud = rate;
+        SetInitState(GPS_INIT_SWITCH);
+    }
+
+    else SetInitState(GPS_INIT_READY);
+}
+
+void GPS::Retry(void)
+{
+    if(initAttempt++ < initRetries) SetInitState(GPS_INIT_START);
+    else SetInitState(GPS_INIT_FAILED);
+}
+
+bool GPS::SendSiRFBaud(uint32_t rate)
+{
+    if(linkProtocol == GPS_NMEA)
+    {
+        char str[32];
+        sprintf(str, "PSRF100,1,%lu,8,1,0", (unsigned long)rate); //staying in NMEA
+        return SendNMEA(str);
+    }
+
+    //MID 134, set binary serial port: rate (big-endian), 8 data bits, 1 stop bit, no parity
+    uint8_t msg[] = {0x86, (uint8_t)(rate >> 24), (uint8_t)(rate >> 16), (uint8_t)(rate >> 8), (uint8_t)rate, 8, 1, 0, 0};
+    return SendBinary(msg, 9);
 }
 
-long GPSDatum::ConvertToDMM(const String& degStr) // "decimilliminutes": divide be 10000 to get minutes
+uint8_t GPS::PollCommands(void)
 {
-  int iDecimal = degStr.indexOf('.');
-  if(iDecimal == -1) return 0;
+    GPSAck ack;
+    while(acks.Pop(ack)) commands.Acknowledge(ack.ack, ack.id, ack.accepted);
 
-  long dmm = degStr.substring(0, iDecimal - 2).toInt() * 600000L;
-  dmm += degStr.substring(iDecimal - 2, iDecimal).toInt() * 10000L;
-  dmm += degStr.substring(iDecimal + 1).toInt();
+    //nothing goes out while the receiver is being brought up, or if it never came up
+    if(initState != GPS_INIT_OFF && PollInit() != GPS_INIT_READY)
+    {
+        if(initState == GPS_INIT_FAILED) commands.Drop();
+    }
+
+    else while(GPSCommand* command = commands.Next(millis()))
+    {
+        if(command->binary) SendBinary(command->data, command->length);
+        else
+        {
+            char body[GPS_COMMAND_LENGTH + 1];
+            memcpy(body, command->data, command->length);
+            body[command->length] = 0;
+            SendNMEA(body);
+        }
 
-  return dmm;
+        if(command->protocol) SwitchProtocol((GPS_PROTOCOL)command->protocol);
+        commands.Sent(millis());
+    }
+
+    awaitingPMTK = commands.Awaiting(GPS_ACK_PMTK);
+    return commands.Pending();
 }
 
-int GPSDatum::NMEAtoTime(const String& timeStr)
+void GPS::ProcessProprietary(const char* line, uint16_t length)
 {
-  if(timeStr.length() < 6) return 0;
+    NMEATokenizer fields(line, length);
+
+    //PMTK001,cmd,flag: flag 3 is success; 0 - 2 are invalid, unsupported, and failed
+    if(fields[0].Equals("PMTK001")) acks.Push({GPS_ACK_PMTK, (uint16_t)fields[1].ToInt(), fields[2] == '3'});
+}
+
+uint16_t GPS::Dispatch(uint16_t maxBytes)
+/*
+ * Processes what the UART has (but no more than maxBytes, if it's non-zero), calling
+ * handlers as things complete. Returns the number of bytes processed, so 0 means there
+ * was nothing to do.
+ */
+{
+    FlushEpochs();
+    PollCommands();
+    Sync();
+
+    uint16_t count = 0;
+    if(gpsProtocol == GPS_BINARY)
+    {
+        while((!maxBytes || count < maxBytes) && (sirfFramer.Replaying() || serial->available()))
+        {
+            ProcessFrameState(sirfFramer.Replaying() ? sirfFramer.Replay() : sirfFramer.AddByte(serial->read()));
+            count++;
+        }
+    }
 
-  hour = timeStr.substring(0, 2).toInt();
-  minute = timeStr.substring(2, 4).toInt();
-  second = timeStr.substring(4, 6).toInt();
-    
-    int8_t decIndex = timeStr.indexOf('.');
-    if(decIndex != -1)
-        msec = timeStr.substring(decIndex + 1).toInt();
     else
-        msec = 0;
-    
-  return 1;
+    {
+        while((!maxBytes || count < maxBytes) && serial->available())
+        {
+            ProcessNMEAChar(serial->read());
+            count++;
+        }
+    }
+
+    return count;
 }
 
-int GPSDatum::NMEAtoDate(const String& dateStr)
+GPSPollResult GPS::CheckSerial(uint16_t maxBytes, uint32_t maxMicros)
+/*
+ * CheckSerial() with a bound on the work done: at most maxBytes bytes and (roughly, the
+ * check is per byte) maxMicros us; 0 means no limit. Stops early rather than drop an
+ * entry from the result, so nothing is lost by calling it again later.
+ */
 {
-  if(dateStr.length() != 6) return 0;
+    GPSPollResult result;
+    uint32_t start = maxMicros ? micros() : 0;
 
-  day = dateStr.substring(0, 2).toInt();
-  month = dateStr.substring(2, 4).toInt();
-  year = dateStr.substring(4, 6).toInt();
-  
-  return 1;
+    result.status = FlushEpochs();
+    PollCommands();
+    Sync();
+
+    bool binary = gpsProtocol == GPS_BINARY;
+    while((binary && sirfFramer.Replaying()) || serial->available())
+    {
+        if((maxBytes && result.bytes >= maxBytes) || result.count == GPS_POLL_RESULTS
+           || (maxMicros && micros() - start >= maxMicros))
+        {
+            result.more = true;
+            break;
+        }
+
+        uint8_t status = binary ? ProcessFrameState(sirfFramer.Replaying() ? sirfFramer.Replay() : sirfFramer.AddByte(serial->read()))
+                                : ProcessNMEAChar(serial->read());
+        result.bytes++;
+
+        if(status & GPS_STR) result.completed[result.count++] = lastCompleted;
+
+        if(status & ~GPS_STR) result.status = status;
+        else result.status |= status;
+    }
+
+    return result;
+}
+
+uint8_t GPS::SentenceFlag(uint32_t key)
+/*
+ * GGA, RMC, etc. for a sentence key (see NMEASentenceKey()), PROPRIETARY for any 'P'
+ * sentence, or 0 for a type we don't parse
+ */
+{
+#define GPS_NMEA_FLAG(type, parser) case NMEAKey(#type): return type;
+
+    switch(key)
+    {
+        GPS_NMEA_SENTENCES(GPS_NMEA_FLAG)
+        default: break;
+    }
+
+#undef GPS_NMEA_FLAG
+
+    return key > 0xFFFFFF ? PROPRIETARY : 0; //standard keys are three characters
+}
+
+uint8_t GPS::ProcessNMEAChar(char c)
+{
+    NMEA_LINE_STATE lineState = nmeaLine.AddChar(c);
+
+    //"$GPGGA" or "$PMTK0" is enough to know whether we want it
+    if(sentenceFilter && lineState == LINE_RECEIVING && nmeaLine.Length() == 6)
+    {
+        uint8_t flag = SentenceFlag(nmeaLine.HeaderKey());
+        if(!(flag & sentenceFilter) && !(flag == PROPRIETARY && awaitingPMTK)) nmeaLine.Skip();
+        return 0;
+    }
+    if(lineState == LINE_COMPLETE)
+    {
+        heardCount++;
+        if(nmeaLine.GetLine()[1] == 'P') ProcessProprietary(nmeaLine.GetLine(), nmeaLine.Length());
+
+        GPSDatum newReading = ParseVerifiedNMEA(nmeaLine.GetLine(), nmeaLine.Length()); //checksum was checked on the way in
+        lastCompleted = newReading.source;
+        if(!newReading.source) return GPS_STR;
+
+        Stamp(newReading, nmeaLine.StartMicros());
+
+        if(sentenceHandler && (newReading.source & sentenceTypes)) sentenceHandler(newReading, sentenceContext);
+
+        epochs.Add(newReading);
+        return FlushEpochs() | GPS_STR;
+    }
+
+    if(lineState == LINE_CHECKSUM_ERROR) //corrupt, so don't bother parsing it
+    {
+        lastCompleted = 0;
+        ReportError(GPS_ERROR_CHECKSUM);
+        return GPS_STR;
+    }
+
+    if(lineState == LINE_OVERFLOW) ReportError(GPS_ERROR_OVERFLOW);
+
+    return 0;
+}
+
+uint8_t GPS::Ingest(uint8_t byte)
+/*
+ * For bytes that come from somewhere other than serial->read(), e.g., straight from
+ * the UART interrupt or out of an SPSCQueue. Returns as CheckSerial() does. Handlers
+ * run in the caller's context, so if that's an ISR, keep them short (GPSQueueDatum()).
+ * See the notes on class GPS for what loop() can still touch meanwhile.
+ */
+{
+    Sync();
+    if(gpsProtocol != GPS_BINARY) return ProcessNMEAChar(byte);
+
+    uint8_t retVal = ProcessFrameState(sirfFramer.AddByte(byte));
+    while(sirfFramer.Replaying()) //after a bad frame, the framer rescans what it had swallowed
+    {
+        uint8_t result = ProcessFrameState(sirfFramer.Replay());
+        if(result & ~GPS_STR) retVal = result;
+        else retVal |= result;
+    }
+
+    return retVal;
+}
+
+uint8_t GPS::ProcessFrameState(MESSAGE_STATE msgState)
+{
+    if(msgState == COMPLETE)
+    {
+        GPSMessage message = sirfFramer.GetMessage();
+        lastCompleted = message.msgID;
+        heardCount++;
+
+        if(message.msgID == 11 || message.msgID == 12) acks.Push({GPS_ACK_SIRF, message.U8(1), message.msgID == 11}); //ACK, NACK
+
+        for(uint8_t i = 0; i < GPS_MESSAGE_HANDLERS; i++)
+        {
+            if(messageHandlers[i].handler && (!messageHandlers[i].msgID || messageHandlers[i].msgID == message.msgID))
+                messageHandlers[i].handler(message, messageHandlers[i].context);
+        }
+
+        GPSDatum newReading = ParseSiRF(message);
+        if(!newReading.source) return GPS_STR;
+
+        Stamp(newReading, sirfFramer.StartMicros());
+
+        if(sentenceHandler && (newReading.source & sentenceTypes)) sentenceHandler(newReading, sentenceContext);
+
+        epochs.Add(newReading); //MID 41 is a whole epoch on its own (GGA | RMC)
+        return FlushEpochs() | GPS_STR;
+    }
+
+    if(msgState == LENGTH_ERROR) ReportError(GPS_ERROR_FRAME_LENGTH);
+    else if(msgState == EPILOG_ERROR) ReportError(GPS_ERROR_FRAME_EPILOG);
+    else if(msgState == CHECKSUM_ERROR) ReportError(GPS_ERROR_FRAME_CHECKSUM);
+
+    return 0;
+}
+
+void GPS::Stamp(GPSDatum& reading, uint32_t started)
+/*
+ * The PPS edge of a second comes before the data for any time in that second, and we
+ * assume the data takes less than a second to follow. So the edge for a reading is the
+ * later of the last two that's at least its msec ahead of it, and no more than a second
+ * more than that. (The epoch keeps its first reading's stamps.)
+ */
+{
+    reading.rxMicros = started;
+    if(!GPSDatum::IsTimed(reading.source)) return;
+
+    uint32_t edges[2];
+    uint8_t count;
+    do //an edge could come in while we're copying
+    {
+        edges[0] = ppsAt;
+        edges[1] = ppsBefore;
+        count = ppsCount;
+    } while(edges[0] != ppsAt);
+
+    uint32_t offset = reading.msec * 1000UL;
+    for(uint8_t i = 0; i < count; i++)
+    {
+        uint32_t since = started - edges[i];
+        if(since >= offset && since - offset < 1000000UL)
+        {
+            reading.ppsMicros = edges[i] + offset;
+            return;
+        }
+    }
+}
+
+uint8_t GPS::FlushEpochs(void)
+{
+    uint8_t retVal = 0;
+    while(uint8_t emitted = epochs.Check())
+    {
+        if(epochHandler) epochHandler(epochs.GetEpoch(), epochContext);
+        retVal = emitted;
+    }
+
+    return retVal;
 }
 
 String GPS::MakeNMEAwithChecksum(const String& str)
 {
-  String checkSum = String(CalcChecksum(str), HEX);
-  checkSum.toUpperCase();
-  return '$' + str + '*' + checkSum + "\r\n";
+  char tail[6];
+  sprintf(tail, "*%02X\r\n", CalcChecksum(str));
+  return '$' + str + tail;
 }
 
-GPSDatum GPS::ParseNMEA(const String& nmeaStr)
+GPSDatum GPS::ParseNMEA(const char* nmeaStr, uint16_t length)
 {
     //SerialUSB.println(nmeaStr);
-    GPSDatum gpsDatum;
-    
-    uint16_t length = nmeaStr.length();
-    if(length < 3) return 0;
-    
-    if(nmeaStr[0] != '$') return 0;
-    if(nmeaStr[length - 3] != '*') return 0;
-    
-    uint8_t checksum = CalcChecksum(nmeaStr.substring(1, length - 3));
-    String checksumStr = String(checksum, HEX);
-    checksumStr.toUpperCase();
-    String checksumNMEA = nmeaStr.substring(length - 2);
-    
-    if(checksumStr != checksumNMEA) return gpsDatum;
-    
-    String NMEAtype = GetNMEASubstring(nmeaStr, 0);
-    
-    if (NMEAtype == "GPGGA")
-    {
-        gpsDatum.gpsFix = GetNMEASubstring(nmeaStr, 6).toInt();
-        if(!gpsDatum.gpsFix) return gpsDatum;
-        
-        // time
-        gpsDatum.NMEAtoTime(GetNMEASubstring(nmeaStr, 1));
-        
-        gpsDatum.lat = ConvertToDMM(GetNMEASubstring(nmeaStr, 2));
-        if(GetNMEASubstring(nmeaStr, 3) == String('S')) gpsDatum.lat *= -1;
-        
-        gpsDatum.lon = ConvertToDMM(GetNMEASubstring(nmeaStr, 4));
-        if(GetNMEASubstring(nmeaStr, 5) == String('W')) gpsDatum.lon *= -1;
-        
-        gpsDatum.elevDM = GetNMEASubstring(nmeaStr, 9).toFloat() * 10;
-        
-        gpsDatum.source = GGA;
-        return gpsDatum;
-    }
-    
-    if(NMEAtype == "GPRMC")
-    {
-        if(GetNMEASubstring(nmeaStr, 2) != String('A')) return gpsDatum;
-        //else gpsDatum.gpsFix = 1;
-        
-        gpsDatum.lat = ConvertToDMM(GetNMEASubstring(nmeaStr, 3));
-        if(GetNMEASubstring(nmeaStr, 4) == String('S')) gpsDatum.lat *= -1;
-        
-        gpsDatum.lon = ConvertToDMM(GetNMEASubstring(nmeaStr, 5));
-        if(GetNMEASubstring(nmeaStr, 6) == String('W')) gpsDatum.lon *= -1;
-        
-        //gpsDatum.speed = GetNMEASubstring(nmeaStr, 7).toFloat();
-        
-        gpsDatum.NMEAtoTime(GetNMEASubstring(nmeaStr, 1));
-        gpsDatum.NMEAtoDate(GetNMEASubstring(nmeaStr, 9));
-        
-        gpsDatum.source = RMC;
-        return gpsDatum;
-    }
-    
-    return 0;
+    if(!VerifyChecksum(nmeaStr, length)) return 0;
+
+    return ParseVerifiedNMEA(nmeaStr, length);
 }
 
-String GPS::GetNMEASubstring(const String& str, int commaIndex)
+GPSDatum GPS::ParseVerifiedNMEA(const char* nmeaStr, uint16_t length)
 /*
- * grabs the substring of an NMEA string after comma number commaIndex
+ * for sentences whose checksum has already been checked, e.g., by NMEALineBuffer
  */
 {
-    int iComma = 0;
-    for(int i = 0; i < commaIndex; i++)
+    GPSDatum gpsDatum;
+
+    NMEATokenizer fields(nmeaStr, length);
+
+#define GPS_NMEA_CASE(type, parser) case NMEAKey(#type): parser(fields, gpsDatum); break;
+
+    switch(NMEASentenceKey(fields[0]))
     {
-        iComma = str.indexOf(',', iComma + 1);
-        if(iComma == -1) return String("");
+        GPS_NMEA_SENTENCES(GPS_NMEA_CASE)
+        default: return 0; //not one of ours
     }
-    
-    int iCommaNext = str.indexOf(',', iComma + 1);
-    if(iCommaNext == -1) return String("");
-    
-    return str.substring(iComma + 1, iCommaNext);
+
+#undef GPS_NMEA_CASE
+
+    return gpsDatum;
+}
+
+uint8_t GPS::ParseGGA(const NMEATokenizer& fields, GPSDatum& gpsDatum)
+{
+    gpsDatum.gpsFix = fields[6].ToInt();
+    if(!gpsDatum.gpsFix) return 0;
+
+    // time
+    gpsDatum.NMEAtoTime(fields[1]);
+
+    gpsDatum.lat = GPSDatum::ConvertToDMM(fields[2]);
+    if(fields[3] == 'S') gpsDatum.lat *= -1;
+
+    gpsDatum.lon = GPSDatum::ConvertToDMM(fields[4]);
+    if(fields[5] == 'W') gpsDatum.lon *= -1;
+
+    gpsDatum.satsUsed = fields[7].ToInt();
+    gpsDatum.hdop = fields[8].ToFixed(2);
+    gpsDatum.elevDM = fields[9].ToFixed(1);
+
+    return gpsDatum.source = GGA;
 }
 
-long GPS::ConvertToDMM(const String& degStr)
+uint8_t GPS::ParseRMC(const NMEATokenizer& fields, GPSDatum& gpsDatum)
 {
-    int iDecimal = degStr.indexOf('.');
-    if(iDecimal == -1) return 0;
-    
-    long dmm = degStr.substring(0, iDecimal - 2).toInt() * 600000L;
-    dmm += degStr.substring(iDecimal - 2, iDecimal).toInt() * 10000L;
-    dmm += degStr.substring(iDecimal + 1).toInt();  //careful -- this assumes it's exactly five digits!!!!!!!!!!!
-    
-    return dmm;
+    if(fields[2] != 'A') return 0;
+    //else gpsDatum.gpsFix = 1;
+
+    gpsDatum.lat = GPSDatum::ConvertToDMM(fields[3]);
+    if(fields[4] == 'S') gpsDatum.lat *= -1;
+
+    gpsDatum.lon = GPSDatum::ConvertToDMM(fields[5]);
+    if(fields[6] == 'W') gpsDatum.lon *= -1;
+
+    gpsDatum.speedCMS = fields[7].ToFixed(2) * 1852 / 3600; //knots
+    gpsDatum.courseCD = fields[8].ToFixed(2);
+
+    gpsDatum.NMEAtoTime(fields[1]);
+    gpsDatum.NMEAtoDate(fields[9]);
+
+    return gpsDatum.source = RMC;
+}
+
+uint8_t GPS::ParseGSA(const NMEATokenizer& fields, GPSDatum& gpsDatum)
+{
+    gpsDatum.fixMode = fields[2].ToInt();
+    gpsDatum.hdop = fields[16].ToFixed(2);
+
+    return gpsDatum.source = GSA;
+}
+
+uint8_t GPS::ParseGSV(const NMEATokenizer& fields, GPSDatum& gpsDatum)
+{
+    gpsDatum.satsInView = fields[3].ToInt();
+
+    return gpsDatum.source = GSV;
+}
+
+uint8_t GPS::ParseVTG(const NMEATokenizer& fields, GPSDatum& gpsDatum)
+{
+    if(fields[9] == 'N') return 0; //mode indicator (NMEA 2.3 on): data not valid
+
+    gpsDatum.courseCD = fields[1].ToFixed(2);
+    gpsDatum.speedCMS = fields[7].ToFixed(2) * 10 / 36; //km/h
+
+    return gpsDatum.source = VTG;
+}
+
+uint8_t GPS::ParseZDA(const NMEATokenizer& fields, GPSDatum& gpsDatum)
+{
+    if(!gpsDatum.NMEAtoTime(fields[1])) return 0;
+
+    gpsDatum.day = fields[2].ToInt();
+    gpsDatum.month = fields[3].ToInt();
+    gpsDatum.year = fields[4].ToInt() % 100;
+
+    return gpsDatum.source = ZDA;
+}
+
+GPSDatum GPS::ParseSiRF(const GPSMessage& message)
+/*
+ * MID 41 (geodetic navigation data) carries everything GGA and RMC do, so it fills in
+ * both and is flagged as both. Other MIDs don't make a datum; see the views in gps_sirf.h.
+ */
+{
+    GPSDatum gpsDatum;
+
+    SiRFGeodeticNav nav(message);
+    if(!nav.IsValid()) return gpsDatum;
+
+    if(nav.NavValid() || !(nav.NavType() & 0x07)) return gpsDatum; //no fix
+    gpsDatum.gpsFix = (nav.NavType() & 0x80) ? 2 : 1; //as in GGA: 1 = GPS, 2 = DGPS
+
+    gpsDatum.year = nav.Year() % 100;
+    gpsDatum.month = nav.Month();
+    gpsDatum.day = nav.Day();
+
+    gpsDatum.hour = nav.Hour();
+    gpsDatum.minute = nav.Minute();
+    gpsDatum.second = nav.SecondMS() / 1000;
+    gpsDatum.msec = nav.SecondMS() % 1000;
+
+    //degrees * 10^7 to decimilliminutes is * 600000 / 10^7
+    gpsDatum.lat = ((int64_t)nav.Latitude() * 3) / 50;
+    gpsDatum.lon = ((int64_t)nav.Longitude() * 3) / 50;
+
+    gpsDatum.elevDM = nav.AltitudeMSL() / 10;
+
+    gpsDatum.speedCMS = nav.SpeedOverGround();
+    gpsDatum.courseCD = nav.CourseOverGround();
+    gpsDatum.satsUsed = nav.SVsInFix();
+    gpsDatum.hdop = nav.HDOP() * 20; //sent as HDOP * 5
+
+    gpsDatum.source = GGA | RMC;
+    return gpsDatum;
 }
@@ -2,58 +2,38 @@
 #define __GPS_H
 
 #include <Arduino.h> // for byte data type
-#include <vector_uC.h>
+#include <gps_nmea.h>
+#include <gps_sirf.h>
+#include <gps_queue.h>
+#include <gps_format.h>
+#include <gps_command.h>
+#include <gps_time.h>
 
 #define GGA 0x01
 #define RMC 0x02
 #define GSA 0x04
 #define GSV 0x08
+#define VTG 0x10
+#define ZDA 0x20
+#define PROPRIETARY 0x40 //'P' sentences, for SetSentenceFilter()
 #define GPS_STR 0x80    //used to indicate that a string was received, even if there is no lock
 
+/*
+ * The sentences ParseNMEA understands, one entry each: the formatter (which doubles as
+ * the flag) and the GPS member that parses it. The talker ID is ignored, so GNGGA,
+ * GLGGA, etc. are parsed the same as GPGGA. Adding a sentence type is one line here.
+ */
+#define GPS_NMEA_SENTENCES(SENTENCE) \
+    SENTENCE(GGA, ParseGGA) \
+    SENTENCE(RMC, ParseRMC) \
+    SENTENCE(GSA, ParseGSA) \
+    SENTENCE(GSV, ParseGSV) \
+    SENTENCE(VTG, ParseVTG) \
+    SENTENCE(ZDA, ParseZDA)
+
 #define KNOTS_TO_KMH 1.852001
 
 enum GPS_PROTOCOL {GPS_NMEA = 1, GPS_BINARY};
-enum MESSAGE_STATE {WAITING0, WAITING1, SIZE0, SIZE1, PAYLOAD, CHECK0, CHECK1, CLOSE0, CLOSE1, COMPLETE, EPILOG_ERROR = 253, CHECKSUM_ERROR = 254, ERROR = 255};
-
-#define vector_u8 TVector<uint8_t>
-
-class GPSMessage //binary messages; really a struct?
-{
-protected:
-    uint16_t index = 0; //to keep track of additions
-    uint16_t checksum = 0x8000;
-    uint16_t runningSum = 0;
-    
-public:
-    GPSMessage(uint16_t size) : payload(size) {index = 0;}
-    
-    uint8_t msgID = 0;
-    vector_u8 payload; //includes MID as byte 0
-    
-    uint16_t AddByteToPayload(uint8_t b)
-    {
-        if(index == 0) msgID = b; //double storing, but it also acts as an indicator
-        
-        if(index < payload.Length())
-        {
-            payload[index++] = b;
-            runningSum += b;
-        }
-        
-        return index;
-    }
-    
-    uint16_t AddChecksum(uint8_t b)
-    //bit 16 is always 0 in the checksum, so we'll use that to indicate which byte we're working on
-    {
-        if(checksum & 0x8000) //first byte
-            checksum = ((uint16_t)b << 8);
-        else
-            checksum |= b;
-        
-        return checksum ^ (runningSum & 0x7fff); //zero when checksum is correct
-    }
-};
 
 class GPSDatum 
 {
@@ -61,7 +41,8 @@ public:
   uint8_t source = 0; //indicates which strings/readings were used to create it
 
   uint8_t day = 0, month = 0, year = 0;
-    uint8_t hour, minute, second, msec;
+    uint8_t hour = 0, minute = 0, second = 0;
+    uint16_t msec = 0;
   
   int32_t lat = -99;
   int32_t lon = -199;
@@ -70,7 +51,16 @@ public:
 
   uint16_t gpsFix = 0; //2-bytes to make size % 4
 
+  uint8_t satsUsed = 0; //GGA
+  uint8_t satsInView = 0; //GSV
+  uint8_t fixMode = 0; //GSA: 1 = none, 2 = 2D, 3 = 3D
+  uint16_t hdop = 0; //HDOP * 100, from GGA or GSA
+  uint16_t speedCMS = 0; //speed over ground, cm/s, from RMC or VTG
+  uint16_t courseCD = 0; //course over ground, centidegrees, from RMC or VTG
+
   uint32_t timestamp = 0; //used to hold value from millis(), not true timestamp
+  uint32_t rxMicros = 0; //micros() at the first byte of the sentence or frame (for an epoch, its first)
+  uint32_t ppsMicros = 0; //micros() at the instant of the UTC time, from the PPS edge; 0 if there was none to go by
 
 public:
     GPSDatum(uint32_t ts = millis()) : timestamp(ts) {}
@@ -79,9 +69,13 @@ public:
     uint8_t ParseNMEA(const String& str);
     
   static String GetNMEASubstring(const String& str, int commaIndex);
-  static long ConvertToDMM(const String& degStr);
-  int NMEAtoTime(const String& timeStr);
-  int NMEAtoDate(const String& dateStr);
+  static long ConvertToDMM(const NMEAField& degStr);
+  int NMEAtoTime(const NMEAField& timeStr);
+  int NMEAtoDate(const NMEAField& dateStr);
+
+  static long ConvertToDMM(const String& degStr) {return ConvertToDMM(NMEAField(degStr.c_str(), degStr.length()));}
+  int NMEAtoTime(const String& timeStr) {return NMEAtoTime(NMEAField(timeStr.c_str(), timeStr.length()));}
+  int NMEAtoDate(const String& dateStr) {return NMEAtoDate(NMEAField(dateStr.c_str(), dateStr.length()));}
 
 //    static uint8_t CalcChecksum(const String& str)
 //    {
@@ -107,104 +101,453 @@ public:
 //        return checksum;
 //    }
     
-  int Merge(const GPSDatum& newReading)
+  uint32_t TimeOfDayMS(void) const {return ((hour * 60UL + minute) * 60UL + second) * 1000UL + msec;}
+  void SetTimeOfDayMS(uint32_t ms)
   {
-    int retVal = 0;
-    if(newReading.hour == hour && newReading.minute == minute && newReading.second == second && newReading.msec == msec)
-    {
-      if(newReading.source & RMC)
-      {
-        year = newReading.year;
-        month = newReading.month;
-        day = newReading.day;
+    msec = ms % 1000;
+    second = (ms / 1000) % 60;
+    minute = (ms / 60000) % 60;
+    hour = ms / 3600000;
+  }
 
-        //speed = newReading.speed;
-      }
+  //Unix time in ms, for sorting, differencing and storing fixes; see gps_time.h
+  bool HasDate(void) const {return month >= 1 && month <= 12 && day;} //RMC and ZDA have one; GGA doesn't
+  uint64_t EpochMS(void) const {return HasDate() ? GPSEpochMS(GPSFullYear(year), month, day, TimeOfDayMS()) : 0;} //0 without a date
+  uint64_t EpochMS(uint64_t reference) const {return HasDate() ? EpochMS() : GPSEpochNear(TimeOfDayMS(), reference);} //dates a GGA by, e.g., the last RMC
+  void SetEpochMS(uint64_t ms);
 
-      else if(newReading.source & GGA)
-      {
-        elevDM = newReading.elevDM;
-        gpsFix = newReading.gpsFix;
-      }
+  //GSA, GSV and VTG don't carry a time; they belong to whatever epoch is current
+  static bool IsTimed(uint8_t sources) {return sources & (GGA | RMC | ZDA);}
 
-      source |= newReading.source;
-      retVal = source; 
+  void MergeFields(const GPSDatum& newReading); //takes whatever newReading's sentences carry
+    
+  int Merge(const GPSDatum& newReading)
+  {
+    int retVal = 0;
+    
+    bool untimed = !IsTimed(newReading.source);
+    if(untimed || newReading.TimeOfDayMS() == TimeOfDayMS())
+    {
+      MergeFields(newReading);
+      retVal = untimed ? newReading.source : source; //an untimed sentence doesn't complete the epoch again
     }
 
     return retVal;
   }
     
-    String MakeDataString(void)
+    /*
+     * Formatters: each writes into buf (null-terminated) and returns the length, or 0 if
+     * it didn't fit. Integer-only; see gps_format.cpp for the layouts.
+     */
+    uint16_t FormatCSV(char* buf, uint16_t size) const; //what MakeDataString() gives
+    uint16_t FormatShortCSV(char* buf, uint16_t size) const; //what MakeShortDataString() gives
+    uint16_t FormatISOTime(char* buf, uint16_t size) const;
+    uint16_t FormatDegrees(char* buf, uint16_t size) const;
+    uint16_t FormatJSON(char* buf, uint16_t size) const; //~190 chars
+
+    String MakeDataString(void) const
     {
-        if(gpsFix)
-        {
-            char dataStr[100];
-            
-            sprintf(dataStr, "%lu,%i,%02i:%02i:%02i,%li,%li,%2.1f",
-                    timestamp,
-//                    source, %X
-                    gpsFix,
-//                    year,
-//                    month,
-//                    day,
-                    hour,
-                    minute,
-                    second,
-                    lat,
-                    lon,
-                    (elevDM / 10.0));
-            return String(dataStr);
-        }    
-        else
-            return String("0");
+        char dataStr[64];
+        FormatCSV(dataStr, sizeof(dataStr));
+        return String(dataStr);
     }
     
-    String MakeShortDataString(void)
+    String MakeShortDataString(void) const
     {
-        char dataStr[100];
-        
-        sprintf(dataStr, "%02i:%02i:%02i,%2.2f",
-//                timestamp,
-//                gpsFix,
-                hour,
-                minute,
-                second,
-//                lat,
-//                lon,
-                (elevDM / 10.0));
-        
+        char dataStr[20];
+        FormatShortCSV(dataStr, sizeof(dataStr));
         return String(dataStr);
     }
+
+protected:
+    void WriteISOTime(GPSWriter& out) const;
+};
+
+#ifndef GPS_EPOCH_SLOTS
+#define GPS_EPOCH_SLOTS 3
+#endif
+
+#ifndef GPS_EPOCH_TIMEOUT
+#define GPS_EPOCH_TIMEOUT 1500 //ms; a 1 Hz burst of GGA..RMC takes most of a second at 4800 baud
+#endif
+
+class GPSEpochAssembler
+/*
+ * Collects readings into epochs -- everything that shares a UTC time -- in a small ring
+ * of slots, so interleaved or dropped sentences don't cost the data already in. An
+ * epoch is emitted as soon as the required sentences are in, when it has been open
+ * longer than the timeout, or when its slot is needed for a newer one. The source of
+ * an emitted epoch is its completeness mask: the sentences that actually went into it.
+ *
+ * Untimed sentences (GSA, GSV, VTG) join the most recently opened epoch, so sentences
+ * a receiver sends after the last required one are only caught by adding them to the
+ * required set.
+ */
+{
+protected:
+    GPSDatum slots[GPS_EPOCH_SLOTS]; //source == 0 means free
+    uint8_t latest = GPS_EPOCH_SLOTS; //slot that untimed readings go to; none yet
+
+    GPSDatum epoch; //last one emitted
+    bool evicted = false; //epoch holds an evicted epoch that Check() hasn't reported yet
+
+    uint8_t required = GGA | RMC;
+    uint16_t timeout = GPS_EPOCH_TIMEOUT;
+
+    void Emit(uint8_t i)
+    {
+        epoch = slots[i];
+        slots[i].source = 0;
+        if(latest == i) latest = GPS_EPOCH_SLOTS;
+    }
+
+public:
+    GPSEpochAssembler(void) : epoch(0) {}
+
+    void SetRequired(uint8_t sentences) {required = sentences;}
+    uint8_t GetRequired(void) const {return required;}
+    void SetTimeout(uint16_t ms) {timeout = ms;}
+
+    void Add(const GPSDatum& reading);
+    uint8_t Check(uint32_t now = millis()); //emits at most one epoch and returns its mask; 0 if none is due
+
+    const GPSDatum& GetEpoch(void) const {return epoch;}
+    bool IsComplete(void) const {return (epoch.source & required) == required;}
+
+    void Reset(void);
+};
+
+/*
+ * Event handlers. Each is registered with a context pointer that is handed back on every
+ * call (e.g., the object that should handle it). The data passed in is only valid for
+ * the duration of the call; copy what you need to keep.
+ */
+typedef void (*GPSDatumHandler)(const GPSDatum& datum, void* context);
+typedef void (*GPSMessageHandler)(const GPSMessage& message, void* context);
+typedef void (*GPSErrorHandler)(uint8_t error, void* context);
+
+template <uint16_t N> void GPSQueueDatum(const GPSDatum& datum, void* queue)
+/*
+ * A handler that pushes onto an SPSCQueue<GPSDatum, N>, passed as the context, e.g.,
+ *   gps.OnEpoch(GPSQueueDatum<8>, &fixQueue);
+ * so epochs completed at interrupt level (see GPS::Ingest()) wait there for loop().
+ */
+{
+    ((SPSCQueue<GPSDatum, N>*)queue)->Push(datum);
+}
+
+enum GPS_ERROR {GPS_ERROR_CHECKSUM = 1, GPS_ERROR_OVERFLOW, GPS_ERROR_FRAME_LENGTH, GPS_ERROR_FRAME_EPILOG, GPS_ERROR_FRAME_CHECKSUM};
+
+//where Begin() has got to; see GPS::PollInit()
+enum GPS_INIT_STATE {GPS_INIT_OFF, GPS_INIT_START, GPS_INIT_WAKE, GPS_INIT_WAIT, GPS_INIT_PROBE, GPS_INIT_SWITCH, GPS_INIT_CONFIRM, GPS_INIT_READY, GPS_INIT_FAILED};
+
+typedef void (*GPSInitHandler)(uint8_t state, uint8_t attempt, void* context); //state is a GPS_INIT_STATE
+typedef void (*GPSBaudHandler)(uint32_t baud, void* context);
+
+#ifndef GPS_INIT_TIMEOUT
+#define GPS_INIT_TIMEOUT 2000 //ms for each attempt to bring the receiver up
+#endif
+
+#ifndef GPS_INIT_RETRIES
+#define GPS_INIT_RETRIES 4 //attempts after the first
+#endif
+
+#define GPS_WAKE_SETTLE 100 //ms from setting up the pins to the first wake pulse
+#define GPS_WAKE_PULSE 5 //ms the on/off input is held high
+
+#ifndef GPS_BAUD_SETTLE
+#define GPS_BAUD_SETTLE 50 //ms from the end of a baud command to changing our side
+#endif
+
+#ifndef GPS_MESSAGE_HANDLERS
+#define GPS_MESSAGE_HANDLERS 4
+#endif
+
+#ifndef GPS_POLL_RESULTS
+#define GPS_POLL_RESULTS 8
+#endif
+
+struct GPSPollResult
+/*
+ * What a budgeted CheckSerial() got done. Everything completed in the call is listed in
+ * order: the flag of each NMEA sentence (0 if it was corrupt, of a type we don't parse,
+ * or had no fix), or the MID of each binary frame.
+ */
+{
+    uint8_t status = 0; //as CheckSerial() returns
+    bool more = false; //the budget ran out with bytes still waiting; call again
+    uint16_t bytes = 0; //processed in this call
+    uint8_t count = 0;
+    uint8_t completed[GPS_POLL_RESULTS];
 };
 
 class GPS
+/*
+ * Bytes are parsed either from loop() (CheckSerial(), Dispatch(), CheckQueue()) or at
+ * interrupt level (Ingest()). In the second case two contexts share the object, so each
+ * member belongs to one side, which is the only one that writes it:
+ *   parsing    the framers, the epoch assembler and the handlers it calls, gpsProtocol,
+ *              lastCompleted, and heardCount
+ *   loop       Begin() and PollInit() state, the command queue, awaitingPMTK,
+ *              linkProtocol, and the settings
+ * The sides only meet through single-writer fields: heardCount is bumped by the parser
+ * and compared against heardMark by PollInit(); when loop() changes the rate or the
+ * protocol, it asks for a restart (Restart()), which the parser carries out in Sync()
+ * before its next byte; the PPS fields are written only by PPS()
+ * and reread by the parser until they hold still. Epochs cross through an SPSCQueue (see
+ * GPSQueueDatum()), and so do acknowledgements, which the parser only passes on for
+ * PollCommands() to match against the queue. GetReading() and GetMessage() read the
+ * parser's state, so with Ingest() in an ISR, take epochs from the queue instead. Set the
+ * subscriptions and SetSentenceFilter() before enabling the interrupt.
+ */
 {
 protected:
-    GPS_PROTOCOL gpsProtocol = GPS_NMEA;
+    GPS_PROTOCOL gpsProtocol = GPS_NMEA; //what the parser is reading
+    volatile uint8_t linkProtocol = GPS_NMEA; //what the receiver has been told to speak; the parser takes it up in Sync()
+
+    //loop() asks the parser to start afresh by bumping restartRequest; see Restart()
+    volatile uint8_t restartRequest = 0;
+    uint8_t restartDone = 0; //parser side
     
-    String gpsString; //working string for storing characters as they roll in across the UART
+    NMEALineBuffer nmeaLine; //working buffer for storing characters as they roll in across the UART
     HardwareSerial* serial; //UART of choice -- no real need to make it a variable, but so be it
 
-    GPSDatum workingDatum; //working datum; we'll try to add new readings to it and return its state
+    GPSEpochAssembler epochs; //readings are merged into epochs here; GetReading() returns the last one out
+
+    SiRFFramer sirfFramer; //used for holding serial data as it comes in; only binary for now
+
+    GPSCommandQueue commands; //configuration, sent as the receiver acknowledges; see QueueNMEA()
+    SPSCQueue<GPSAck, GPS_ACKS> acks; //from the parser to PollCommands()
+    volatile bool awaitingPMTK = false; //the head command wants a PMTK001, so the filter lets it through; set by PollCommands()
+
+    //subscriptions; see OnSentence() etc.
+    GPSDatumHandler sentenceHandler = nullptr;
+    void* sentenceContext = nullptr;
+    uint8_t sentenceTypes = 0;
+
+    GPSDatumHandler epochHandler = nullptr;
+    void* epochContext = nullptr;
+
+    struct
+    {
+        GPSMessageHandler handler = nullptr;
+        void* context = nullptr;
+        uint8_t msgID = 0;
+    } messageHandlers[GPS_MESSAGE_HANDLERS];
+
+    GPSErrorHandler errorHandler = nullptr;
+    void* errorContext = nullptr;
+
+    uint8_t sentenceFilter = 0; //see SetSentenceFilter()
+
+    uint8_t lastCompleted = 0; //flag of the last sentence (0 if it was no use) or MID of the last frame
+
+    //bringing the receiver up; see Begin()
+    uint32_t baud; //the rate the receiver was last heard at (or is expected at)
+    uint32_t maxBaud = 0; //the fastest the receiver can be switched to; 0 if it can't be
+    uint32_t targetBaud = 0; //see SetBaudTarget()
+    uint32_t probeBaud = 0; //the rate being tried while probing or confirming
+    uint32_t openBaud = 0; //the rate the port is open at
+    uint8_t probeIndex = 0; //into the table of rates; 0 is baud itself
+    bool switchFailed = false; //so a failed switch isn't tried again every attempt
+    int8_t onOffPin = -1; //for receivers that are woken with a pulse, like the JF2
+    int8_t sysOnPin = -1; //and say they're awake on a pin; otherwise, a good sentence or frame says so
+
+    uint8_t initState = GPS_INIT_OFF;
+    uint8_t initAttempt = 0;
+    uint8_t initRetries = GPS_INIT_RETRIES;
+    uint16_t initTimeout = GPS_INIT_TIMEOUT;
+    uint32_t initAt = 0; //when the current state was entered
+    volatile uint16_t heardCount = 0; //good sentences or frames; written only by the parser
+    uint16_t heardMark = 0; //heardCount when PollInit() started listening
+
+    GPSInitHandler initHandler = nullptr;
+    void* initContext = nullptr;
+
+    GPSBaudHandler baudHandler = nullptr;
+    void* baudContext = nullptr;
+
+    //the last two PPS edges, in micros(); see PPS()
+    volatile uint32_t ppsAt = 0;
+    volatile uint32_t ppsBefore = 0;
+    volatile uint8_t ppsCount = 0; //edges seen, up to 2
 
-    GPSMessage gpsMessage; //used for holding serial data as it comes in; only binary for now
 public:
-    GPS(HardwareSerial* ser, GPS_PROTOCOL p) : serial(ser), gpsMessage(0)
+    GPS(HardwareSerial* ser, GPS_PROTOCOL p, uint32_t b = 9600) : serial(ser), baud(b)
     {
         gpsProtocol = p;
+        linkProtocol = p;
+    }
+
+    virtual ~GPS(void) {}
+
+    /*
+     * Brings the receiver up without blocking: opens the port, wakes the receiver if it
+     * has an on/off input, and waits for it to show signs of life, retrying a few times.
+     * It moves along each time CheckSerial(), Dispatch(), CheckQueue() or PollCommands()
+     * is called; watch it with OnInit() or GetInitState(). Queued commands wait until the
+     * receiver is up, and are dropped (GPS_COMMAND_DROPPED, to the OnCommand() handler) if
+     * it fails to come up. An attempt can take up to seven timeouts (SYSTEM_ON, then each
+     * rate), and one where a baud switch fails, fourteen, so giving up takes over a minute
+     * with the defaults.
+     */
+    void Begin(uint16_t timeout = GPS_INIT_TIMEOUT, uint8_t retries = GPS_INIT_RETRIES);
+    uint8_t PollInit(void); //returns the GPS_INIT_STATE
+    uint8_t GetInitState(void) const {return initState;}
+
+    /*
+     * Call before Begin() to have it raise the link to the fastest rate up to rate that
+     * the receiver supports, once the receiver has been heard. The switch is confirmed
+     * by hearing the receiver at the new rate; if it isn't, Begin() goes back to the old
+     * one. GetBaud() is the rate the receiver was last heard at.
+     */
+    void SetBaudTarget(uint32_t rate) {targetBaud = rate;}
+    uint32_t GetBaud(void) const {return baud;}
+
+    /*
+     * For a receiver's PPS output: call from the pin's interrupt, e.g.,
+     *   attachInterrupt(digitalPinToInterrupt(PPS_PIN), [] {gps.PPS();}, RISING);
+     * Each reading then gets ppsMicros, the local time of its UTC time to within the
+     * interrupt latency, rather than just rxMicros, which trails it by however long the
+     * receiver took to send it.
+     */
+    void PPS(uint32_t at = micros())
+    {
+        ppsBefore = ppsAt;
+        ppsAt = at;
+        if(ppsCount < 2) ppsCount++;
+    }
+
+    void OnInit(GPSInitHandler handler, void* context = nullptr) //called on every change of state
+    {
+        initHandler = handler;
+        initContext = context;
+    }
+
+    /*
+     * Called each time Begin() opens the port or PollInit() reopens it at another rate,
+     * right after serial->begin() -- e.g., to redo pinPeripheral() for a SERCOM port,
+     * since begin() muxes the pins back to their defaults (see examples/GPS-on-SERCOM).
+     */
+    void OnBaud(GPSBaudHandler handler, void* context = nullptr)
+    {
+        baudHandler = handler;
+        baudContext = context;
+    }
+
+    int Init(uint16_t maxMS = 0)
+    /*
+     * Begin(), returning 1 right away, as it always has; the receiver comes up from
+     * CheckSerial() etc. Given maxMS, it waits up to that long for the outcome instead:
+     * 1 if the receiver came up, 0 if it didn't (yet), in which case the search carries on
+     * as after Begin(). A receiver at the expected rate is up within a timeout or two.
+     */
+    {
+        Begin();
+        if(!maxMS) return 1;
+
+        uint32_t start = millis();
+        while(PollInit() < GPS_INIT_READY && millis() - start < maxMS) Dispatch();
+
+        return initState == GPS_INIT_READY;
+    }
+    
+    String MakeDataString(void) {return epochs.GetEpoch().MakeDataString();}
+
+    GPSMessage GetMessage(void) const {return sirfFramer.GetMessage();} //a view, valid until the next frame starts
+    uint32_t GetSkippedBytes(void) const {return sirfFramer.GetSkippedBytes();} //binary bytes discarded while looking for frames
+  GPSDatum GetReading(void) {return epochs.GetEpoch();}
+
+    /*
+     * Subscriptions. Handlers are called from CheckSerial() or Dispatch() as sentences,
+     * epochs, and binary messages complete, or when something bad comes in. Passing
+     * nullptr as the handler unsubscribes.
+     */
+    void OnSentence(uint8_t types, GPSDatumHandler handler, void* context = nullptr) //types is a mask, e.g., GGA | GSA
+    {
+        sentenceTypes = types;
+        sentenceHandler = handler;
+        sentenceContext = context;
     }
 
-  virtual int Init(void) = 0;
+    void OnEpoch(GPSDatumHandler handler, void* context = nullptr) //see GPSEpochAssembler
+    {
+        epochHandler = handler;
+        epochContext = context;
+    }
+
+    bool OnMessage(uint8_t msgID, GPSMessageHandler handler, void* context = nullptr); //msgID 0 means every message
     
-    String MakeDataString(void) {return workingDatum.MakeDataString();}
+    void OnError(GPSErrorHandler handler, void* context = nullptr) //error is a GPS_ERROR
+    {
+        errorHandler = handler;
+        errorContext = context;
+    }
+
+    uint16_t Dispatch(uint16_t maxBytes = 0);
+
+    /*
+     * Configuration commands are queued and sent one at a time from CheckSerial(),
+     * Dispatch() and CheckQueue(), each once the one before it is acknowledged, so nothing
+     * waits on the receiver (see GPSCommandQueue). If bytes come in through Ingest(), call
+     * PollCommands() from loop() as well. Each returns a ticket for
+     * GetCommandStatus() and the OnCommand() handler, or 0 if the queue is full.
+     */
+    uint8_t QueueNMEA(const char* body) {return commands.AddNMEA(body);} //e.g., "PMTK220,200"
+    uint8_t QueueBinary(const uint8_t* payload, uint8_t length, bool acknowledged = true) {return commands.AddBinary(payload, length, acknowledged);}
 
-    vector_u8 GetMessage(void) {return gpsMessage.payload;}
-  GPSDatum GetReading(void) {return workingDatum;}
+    void OnCommand(GPSCommandHandler handler, void* context = nullptr) {commands.OnComplete(handler, context);}
+    uint8_t GetCommandStatus(uint8_t ticket) const {return commands.GetStatus(ticket);} //a GPS_COMMAND_STATUS
+    void SetCommandTimeout(uint16_t ms, uint8_t retries = GPS_COMMAND_RETRIES) {commands.SetTimeout(ms, retries);}
 
-    static uint8_t CalcChecksum(const String& str)
+    uint8_t PollCommands(void); //sends whatever is due; returns the number of commands not yet finished
+
+    uint8_t Ingest(uint8_t byte);
+
+    template <uint16_t N> uint8_t CheckQueue(SPSCQueue<uint8_t, N>& bytes)
+    /*
+     * Like CheckSerial(), but takes its bytes from a queue that an ISR fills, e.g.,
+     *   while(gpsSerial.available()) byteQueue.Push(gpsSerial.read());
+     * so a long stall in loop() only has to fit in the queue, not the core's UART ring.
+     */
+    {
+        uint8_t retVal = FlushEpochs();
+        PollCommands();
+
+        uint8_t byte;
+        while(bytes.Pop(byte)) //Ingest() does the Sync()
+        {
+            uint8_t result = Ingest(byte);
+            if(result & ~GPS_STR) retVal = result;
+            else retVal |= result;
+        }
+
+        return retVal;
+    }
+
+    /*
+     * Lines whose type isn't in the mask (e.g., GGA | RMC) are dropped as soon as their
+     * header is in, without being stored, checksummed, or parsed -- for receivers that
+     * send more than they're asked to. Types we don't parse are dropped, too; PROPRIETARY
+     * lets 'P' sentences through. 0 (the default) takes every line.
+     */
+    void SetSentenceFilter(uint8_t sentences) {sentenceFilter = sentences;}
+    uint16_t GetFilteredCount(void) const {return nmeaLine.GetSkipCount();}
+
+    static uint8_t SentenceFlag(uint32_t key);
+
+    /*
+     * The sentences an epoch needs before it's reported (default GGA | RMC), and how long
+     * to wait for them. SetActiveNMEAStrings() sets the first to the GGA and RMC it turns
+     * on; call this afterwards to hold epochs for untimed sentences, too.
+     */
+    void SetEpochSentences(uint8_t sentences) {epochs.SetRequired(sentences);}
+    void SetEpochTimeout(uint16_t ms) {epochs.SetTimeout(ms);}
+
+    static uint8_t CalcChecksum(const char* str, uint16_t len)
     {
         uint8_t checksum = 0;
-        for(uint16_t i = 0; i < str.length(); i++)
+        for(uint16_t i = 0; i < len; i++)
         {
             checksum ^= str[i];
         }
@@ -212,6 +555,19 @@ public:
         return checksum;
     }
 
+    static uint8_t CalcChecksum(const String& str) {return CalcChecksum(str.c_str(), str.length());}
+
+    static bool VerifyChecksum(const char* str, uint16_t len) //str is a whole sentence, "$...*hh"
+    {
+        if(len < 4 || str[0] != '$' || str[len - 3] != '*') return false;
+
+        int8_t high = NMEAHexDigit(str[len - 2]);
+        int8_t low = NMEAHexDigit(str[len - 1]);
+        if(high < 0 || low < 0) return false;
+
+        return CalcChecksum(str + 1, len - 4) == ((high << 4) | low);
+    }
+
     static uint16_t CalcChecksumBinary(uint8_t* msg, uint16_t len)
     {
         uint16_t checksum = 0;
@@ -268,141 +624,76 @@ public:
         return 0;
     }
     
-    uint8_t CheckSerialBinary(void)
+    uint8_t CheckSerialBinary(uint16_t maxBytes = 0) //maxBytes = 0 for no limit
     {
-        static MESSAGE_STATE msgState = WAITING0;
-        static uint16_t msgLen = 0;
-        
-        if(msgState == COMPLETE) msgState = WAITING0; //kludge...
-        
-        while(serial->available())
+        Sync();
+        for(uint16_t count = 0; (!maxBytes || count < maxBytes) && (sirfFramer.Replaying() || serial->available()); count++)
         {
-            uint8_t b = serial->read();
-            //SerialUSB.print(b, HEX);
-            
-            switch(msgState)
-            {
-                case WAITING0:
-                    if(b == 0xa0) msgState = WAITING1;
-                    break;
-                case WAITING1:
-                    if(b == 0xA2) msgState = SIZE0;
-                    break;
-                case SIZE0:
-                    msgLen = (uint16_t)b << 8;
-                    msgState = SIZE1;
-                    break;
-                case SIZE1:
-                    msgLen += b;
-                    gpsMessage = GPSMessage(msgLen); //could be faster, long time copying...
-                    msgState = PAYLOAD;
-                    break;
-                case PAYLOAD:
-                {
-                    uint16_t index = gpsMessage.AddByteToPayload(b);
-                    if(index == msgLen) msgState = CHECK0;
-                }
-                    break;
-                case CHECK0:
-                    gpsMessage.AddChecksum(b);
-                    msgState = CHECK1;
-                    break;
-                case CHECK1:
-                {
-                    uint16_t cs = gpsMessage.AddChecksum(b);
-                    if(cs)
-                    {
-                        msgState = WAITING0; //failed checksum
-                        return CHECKSUM_ERROR;
-                    }
-                    
-                    else msgState = CLOSE0;
-                }
-                    break;
-                case CLOSE0:
-                    if(b != 0xB0)
-                    {
-                        msgState = WAITING0; //failed checksum
-                        return EPILOG_ERROR;
-                    }
-                    
-                    else msgState = CLOSE1;
-                    break;
-                case CLOSE1:
-                    if(b != 0xB3)
-                    {
-                        msgState = WAITING0; //failed checksum
-                        return EPILOG_ERROR;
-                    }
-                    
-                    else return msgState = COMPLETE; //need to return since we're only doing one at a time for now
-                case COMPLETE:
-                    msgState = WAITING0; //assume it's been processed
-                    break;
-                default:
-                    msgState = ERROR;
-            }
+            //after a bad frame, the framer replays what it had swallowed before taking new bytes
+            MESSAGE_STATE msgState = sirfFramer.Replaying() ? sirfFramer.Replay() : sirfFramer.AddByte(serial->read());
+            if(msgState == COMPLETE || msgState >= LENGTH_ERROR) return msgState; //need to return since we're only doing one at a time for now
         }
         
-        return msgState;
+        return sirfFramer.GetState();
     }
     
     uint8_t CheckSerialRaw(String& retStr)
     {
+        Sync();
         int retVal = 0;
         while(serial->available())
         {
             char c = serial->read();
             //SerialUSB.print(c);
             
-            if(c != '\n' && c != '\r') gpsString += c;  //ignore carriage return and newline
-            if(c == '\n') //we have a complete string
+            NMEA_LINE_STATE lineState = nmeaLine.AddChar(c);
+            if(lineState == LINE_COMPLETE || lineState == LINE_CHECKSUM_ERROR) //we have a complete string, good or not
             {
-                retStr = gpsString;
-                retVal = gpsString.length();
-
-                gpsString = "";
+                retStr = nmeaLine.GetLine();
+                retVal = nmeaLine.Length();
             }
         }
 
         return retVal;
     }
 
+    uint8_t CheckSerialRaw(uint16_t maxBytes = 0)
+    /*
+     * returns as soon as a line is complete, which is then available from GetLine()
+     * until the next '$' is read; lines with bad checksums are returned, too;
+     * maxBytes = 0 for no limit
+     */
+    {
+        Sync();
+        for(uint16_t count = 0; (!maxBytes || count < maxBytes) && serial->available(); count++)
+        {
+            NMEA_LINE_STATE lineState = nmeaLine.AddChar(serial->read());
+            if(lineState == LINE_COMPLETE || lineState == LINE_CHECKSUM_ERROR) return nmeaLine.Length();
+        }
+
+        return 0;
+    }
+
+    const char* GetLine(void) const {return nmeaLine.GetLine();}
 
+    GPSPollResult CheckSerial(uint16_t maxBytes, uint32_t maxMicros = 0);
 
     uint8_t CheckSerial(void)
+    /*
+     * Returns the completeness mask of an epoch if one was finished (see GPSEpochAssembler),
+     * OR'ed with GPS_STR if any sentence came in.
+     */
     {
-        int retVal = 0;
+        PollCommands();
+        Sync();
+        if(gpsProtocol == GPS_BINARY) return CheckSerialSiRF();
+        
+        uint8_t retVal = FlushEpochs(); //anything that timed out
         while(serial->available())
         {
-            char c = serial->read();
-            //SerialUSB.print(c);
-            
-            if(c != '\n' && c != '\r') gpsString += c;  //ignore carriage return and newline
-            if(c == '\n') //we have a complete string
-            {
-                //                GPSdatum newReading;
-                //                retVal = newReading.ParseNMEA(gpsString); //parse it; retVal holds its type
-                GPSDatum newReading = ParseNMEA(gpsString); //parse it; retVal holds its type
-                retVal = newReading.source | GPS_STR;
-                
-                if(newReading.source) //if we have a valid string
-                {
-                    //first, try to combine it with the previous
-                    int combined = workingDatum.Merge(newReading);
-                    if(combined) //it worked
-                    {
-                        retVal = combined;
-                    }
-                    else //the two don't merge
-                    {
-                        //start anew with the new datum
-                        workingDatum = newReading;
-                    }
-                }
-                
-                gpsString = "";
-            }
+            uint8_t result = ProcessNMEAChar(serial->read());
+            if(result & ~GPS_STR) retVal = result;
+            else retVal |= result;
         }
         
         return retVal;
@@ -455,36 +746,124 @@ public:
             if(serial) serial->write(buffer[i]);
         }
         
-        return 0;
+        return serial ? 1 : 0; //as SendNMEA(): 1 once the frame is written
     }
     
   static String MakeNMEAwithChecksum(const String& str);
-    GPSDatum ParseNMEA(const String& nmeaStr);
-    GPSDatum ParseNMEA(void) {return ParseNMEA(gpsString);}
+    GPSDatum ParseNMEA(const char* nmeaStr, uint16_t length);
+    GPSDatum ParseNMEA(const String& nmeaStr) {return ParseNMEA(nmeaStr.c_str(), nmeaStr.length());}
+    GPSDatum ParseNMEA(void) {return ParseNMEA(nmeaLine.GetLine(), nmeaLine.Length());}
+    GPSDatum ParseSiRF(const GPSMessage& message);
+
+protected:
+    GPSDatum ParseVerifiedNMEA(const char* nmeaStr, uint16_t length);
+
+    //sentence parsers (see GPS_NMEA_SENTENCES); each returns its flag, or 0 if the sentence is no use
+    static uint8_t ParseGGA(const NMEATokenizer& fields, GPSDatum& gpsDatum);
+    static uint8_t ParseRMC(const NMEATokenizer& fields, GPSDatum& gpsDatum);
+    static uint8_t ParseGSA(const NMEATokenizer& fields, GPSDatum& gpsDatum);
+    static uint8_t ParseGSV(const NMEATokenizer& fields, GPSDatum& gpsDatum);
+    static uint8_t ParseVTG(const NMEATokenizer& fields, GPSDatum& gpsDatum);
+    static uint8_t ParseZDA(const NMEATokenizer& fields, GPSDatum& gpsDatum);
+
+    uint8_t CheckSerialSiRF(void) //what CheckSerial does in binary mode
+    {
+        uint8_t retVal = FlushEpochs();
+        while(sirfFramer.Replaying() || serial->available())
+        {
+            //after a bad frame, the framer replays what it had swallowed before taking new bytes
+            uint8_t result = ProcessFrameState(sirfFramer.Replaying() ? sirfFramer.Replay() : sirfFramer.AddByte(serial->read()));
+            if(result & ~GPS_STR) retVal = result;
+            else retVal |= result;
+        }
+        
+        return retVal;
+    }
+
+    //each takes one byte and fires whatever events it completes; returns as CheckSerial() does
+    uint8_t ProcessNMEAChar(char c);
+    uint8_t ProcessFrameState(MESSAGE_STATE msgState); //whatever the framer made of the last byte
+    uint8_t FlushEpochs(void); //reports epochs that are complete or timed out; returns the mask of the last one
+    void ProcessProprietary(const char* line, uint16_t length); //acknowledgements, for now
+    void Stamp(GPSDatum& reading, uint32_t started); //fills in rxMicros and ppsMicros
+
+    void SetInitState(uint8_t state)
+    {
+        initState = state;
+        initAt = millis();
+        if(initHandler) initHandler(state, initAttempt, initContext);
+    }
+
+    void Open(uint32_t rate) //(re)opens the port
+    {
+        serial->begin(rate);
+        openBaud = rate;
+        if(baudHandler) baudHandler(rate, baudContext);
+    }
+
+    void Listen(uint32_t rate, uint8_t state) //at rate, reopening the port only if it's at another, and starts counting what's heard afresh
+    {
+        probeBaud = rate;
+        if(rate != openBaud) Open(rate);
+        Restart();
+        heardMark = heardCount;
+        SetInitState(state);
+    }
 
-protected: //utility functions
-    static String GetNMEASubstring(const String& str, int commaIndex);
-    static long ConvertToDMM(const String& degStr);
-    int NMEAtoTime(const String& timeStr);
-    int NMEAtoDate(const String& dateStr);
+    void Restart(void) {restartRequest++;} //loop side: the parser drops what it has half done, and takes up linkProtocol
 
+    void Sync(void) //parser side, before each byte (or batch of them)
+    {
+        if(restartDone == restartRequest) return;
+
+        restartDone = restartRequest;
+        gpsProtocol = (GPS_PROTOCOL)linkProtocol;
+        nmeaLine.Reset();
+        sirfFramer.Reset();
+    }
+
+    bool HeardSinceMark(void) const {return heardCount != heardMark;} //a 16-bit read is atomic on the M0+
+    void Heard(void); //the receiver is talking at probeBaud: switch, or we're up
+    void Retry(void);
+
+    /*
+     * Tells the receiver to change to rate, right away rather than through the queue, which
+     * is held until the receiver is up. Returns false if the receiver can't be switched.
+     */
+    virtual bool SendBaud(uint32_t rate) {return false;}
+    bool SendSiRFBaud(uint32_t rate); //PSRF100 or MID 134, depending on the protocol
+
+    uint8_t ActiveStringsQueued(uint8_t strings, uint8_t ticket)
+    /*
+     * For SetActiveNMEAStrings(): once the command is queued, an epoch waits for the timed
+     * sentences that are left on, rather than for one that will never come (and the timeout)
+     */
+    {
+        if(ticket && (strings & (GGA | RMC))) epochs.SetRequired(strings & (GGA | RMC));
+        return ticket;
+    }
+
+    void SwitchProtocol(GPS_PROTOCOL protocol) //once the receiver has been told to
+    {
+        linkProtocol = protocol;
+        Restart();
+    }
+    
+    void ReportError(uint8_t error) {if(errorHandler) errorHandler(error, errorContext);}
 };
 
 class GPS_EM506 : public GPS
 {
   public:
-    GPS_EM506(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p) {}
-    int Init(void)
+    GPS_EM506(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p, 4800)
     {
-        serial->begin(4800);
-
-//      SendNMEA(F("PSRF103,02,00,00,01"));
-//      SendNMEA(F("PSRF103,03,00,00,01"));
-//      SendNMEA(F("PSRF103,04,00,01,01"));
-
- 
-      return 1;
+        maxBaud = 57600; //SiRFstarIII
     }
+
+    //to configure once it's up, e.g.,
+//      QueueNMEA("PSRF103,02,00,00,01");
+//      QueueNMEA("PSRF103,03,00,00,01");
+//      QueueNMEA("PSRF103,04,00,01,01");
     
 
 //    bool SetReportPeriod(uint16_t per)
@@ -497,77 +876,80 @@ class GPS_EM506 : public GPS
 //        return true;
 //    }
 //
-    bool SetActiveNMEAStrings(uint8_t strings)
+    uint8_t SetActiveNMEAStrings(uint8_t strings) //ticket of the last of the four commands, or 0 if they don't fit
     {
+        if(commands.Free() < 4) return 0;
+
         char str[96];
 
         sprintf(str, "PSRF103,00,00,%02i,01", strings & GGA ? 1 : 0);
-        SendNMEA(str);
+        QueueNMEA(str);
 
         sprintf(str, "PSRF103,02,00,%02i,01", strings & GSA ? 1 : 0);
-        SendNMEA(str);
+        QueueNMEA(str);
         
         sprintf(str, "PSRF103,03,00,%02i,01", strings & GSV ? 1 : 0);
-        SendNMEA(str);
+        QueueNMEA(str);
         
         sprintf(str, "PSRF103,04,00,%02i,01", strings & RMC ? 1 : 0);
-        SendNMEA(str);
-
-        //should really wait for confirmation
-        return true;
+        return ActiveStringsQueued(strings, QueueNMEA(str)); //PSRF commands aren't acknowledged, so this is done once it's sent
     }
+
+protected:
+    bool SendBaud(uint32_t rate) {return SendSiRFBaud(rate);}
 };
 
 class GPS_MTK3339 : public GPS
 {
 public:
-    GPS_MTK3339(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p) {}
-    int Init(void)
+    GPS_MTK3339(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p, 9600)
     {
-        serial->begin(9600);
-
-        //SetReportPeriod(1000); //rate, in ms; default to 1 Hz
-        //SetActiveNMEAStrings(GGA | RMC);
-        //SendNMEA("PMTK401");
-        //SendNMEA("PMTK413");
-        
-        return 1;
+        maxBaud = 115200;
     }
+
+    //to configure once it's up, e.g.,
+    //SetReportPeriod(1000); //rate, in ms; default to 1 Hz
+    //SetActiveNMEAStrings(GGA | RMC);
+    //QueueNMEA("PMTK401");
+    //QueueNMEA("PMTK413");
     
-    bool SetReportPeriod(uint16_t per)
+    uint8_t SetReportPeriod(uint16_t per) //ticket; done when the receiver acknowledges with PMTK001
     {
         char str[24];
         sprintf(str, "PMTK220,%i", per);
-        SendNMEA(str);
-        
-        //should really wait for confirmation
-        return true;
+        return QueueNMEA(str);
     }
     
-    bool SetActiveNMEAStrings(uint8_t strings)
+    uint8_t SetActiveNMEAStrings(uint8_t strings)
     {
         char str[96];
         sprintf(str, "PMTK314,0,%i,0,%i,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0", strings & RMC ? 1 : 0, strings & GGA ? 1 : 0);
-        SendNMEA(str);
-        
-        //should really wait for confirmation
-        return true;
+        return ActiveStringsQueued(strings, QueueNMEA(str));
+    }
+
+protected:
+    bool SendBaud(uint32_t rate) //not acknowledged; the receiver just changes over
+    {
+        char str[24];
+        sprintf(str, "PMTK251,%lu", (unsigned long)rate);
+        return SendNMEA(str);
     }
 };
 
 class GPS_GP_735 : public GPS
 {
 public:
-    GPS_GP_735(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p) {}
-    int Init(void)
+    GPS_GP_735(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p, 9600)
     {
-        serial->begin(9600);
-        //SetReportPeriod(1000); //rate, in ms; default to 1 Hz
-        //SetActiveNMEAStrings(GGA | RMC);
-        //SendNMEA("PMTK401");
-        //SendNMEA("PMTK413");
-        
-        return 1;
+        maxBaud = 115200;
+    }
+
+protected:
+    bool SendBaud(uint32_t rate) //UART1, with the default protocols in and out
+    {
+        char str[48];
+        sprintf(str, "PUBX,41,1,0007,0003,%lu,0", (unsigned long)rate);
+        return SendNMEA(str);
     }
 };
 
@@ -578,111 +960,77 @@ protected:
     const uint8_t GPS_SYSONPin = A2;
     const uint8_t RXPin = 0;
     const uint8_t TXPin = 1;
-    const uint32_t GPSBaud = 9600;
 
 public:
-    GPS_JF2(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p) {}
-    int Init(void)
+    GPS_JF2(HardwareSerial* ser, GPS_PROTOCOL p = GPS_NMEA) : GPS(ser, p, 9600)
     {
-        serial->begin(GPSBaud);
-        while(!*serial) {}
-
-        pinMode(GPS_SYSONPin, INPUT);
-        digitalWrite(GPS_ONOFFPin, LOW);
-
-        pinMode(GPS_ONOFFPin, OUTPUT);
-        
-        delay(100);
-        
-        while (digitalRead( GPS_SYSONPin ) == LOW )
-        {
-            // Need to wake the module
-            digitalWrite( GPS_ONOFFPin, HIGH );
-            delay(5);
-            digitalWrite( GPS_ONOFFPin, LOW );
-            delay(100);
-        }
-        
-        //delay(500);
-        //SetReportPeriod(1000); //rate, in ms; default to 1 Hz
-        //SetActiveNMEAStrings(GGA | RMC);
-        //SendNMEA("PMTK401");
-        //SendNMEA("PMTK413");
-        
-        return 1;
+        //Begin() pulses ON_OFF until SYSTEM_ON goes high
+        onOffPin = GPS_ONOFFPin;
+        sysOnPin = GPS_SYSONPin;
+        maxBaud = 115200; //SiRFstarIV
     }
     
-    bool SetActiveNMEAStrings(uint8_t strings)
+    uint8_t SetActiveNMEAStrings(uint8_t strings) //ticket of the last of the four commands, or 0 if they don't fit
     {
+        if(commands.Free() < 4) return 0;
+
         char str[96];
         
         sprintf(str, "PSRF103,00,00,%02i,01", strings & GGA ? 1 : 0);
-        SendNMEA(str);
+        QueueNMEA(str);
         
         sprintf(str, "PSRF103,02,00,%02i,01", strings & GSA ? 1 : 0);
-        SendNMEA(str);
+        QueueNMEA(str);
         
         sprintf(str, "PSRF103,03,00,%02i,01", strings & GSV ? 1 : 0);
-        SendNMEA(str);
+        QueueNMEA(str);
         
         sprintf(str, "PSRF103,04,00,%02i,01", strings & RMC ? 1 : 0);
-        SendNMEA(str);
-        
-        //should really wait for confirmation
-        return true;
+        return ActiveStringsQueued(strings, QueueNMEA(str));
     }
     
     uint8_t SetProtocol(GPS_PROTOCOL protocol)
+    /*
+     * Queues the switch; the parser changes over once the command is out. Neither
+     * direction is acknowledged -- the receiver just starts talking the other protocol.
+     * Returns the ticket, or 0 if it's already in that protocol or the queue is full.
+     */
     {
-        if(gpsProtocol == GPS_NMEA) //we're in NMEA mode
+        if(protocol == linkProtocol) return 0;
+
+        if(linkProtocol == GPS_NMEA) //we're in NMEA mode
         {
             char str[96];
-            sprintf(str, "PSRF100,%i,9600,8,1,0", protocol == GPS_BINARY ? 0 : 1);
-            SendNMEA(str);
-            
-            gpsProtocol = (protocol == GPS_BINARY ? GPS_BINARY : GPS_NMEA);
-        }
-        
-        else if(gpsProtocol == GPS_BINARY) //we're in binary mode
-        {
-            uint8_t msg[] = {0x87, 0x02};
-            
-            SendBinary(msg, 2);
-            
-            gpsProtocol = (protocol == GPS_BINARY ? GPS_BINARY : GPS_NMEA);
+            sprintf(str, "PSRF100,0,%lu,8,1,0", (unsigned long)baud);
+            return commands.AddNMEA(str, GPS_BINARY);
         }
         
-        return gpsProtocol;
+        uint8_t msg[] = {0x87, 0x02}; //we're in binary mode
+        return commands.AddBinary(msg, 2, false, GPS_NMEA);
     }
     
-    int8_t SetSBAS(void) //only one option with this device
+    uint8_t SetSBAS(void) //only one option with this device; ticket of the last command, or 0
     {
-        if(gpsProtocol != GPS_BINARY) return -1;
+        if(linkProtocol != GPS_BINARY || commands.Free() < 5) return 0;
         
+        //each waits for the one before it to be acknowledged (MID 11) instead of a delay(1000)
         uint8_t msg[] = {0x85, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
-        SendBinary(msg, 7);
+        QueueBinary(msg, 7);
         
-        delay(1000);
         uint8_t msg_req[] = {0xA6, 0x00, 0x32, 0x01, 0x00, 0x00, 0x00, 0x00};
-        SendBinary(msg_req, 8);
+        QueueBinary(msg_req, 8);
         
-        delay(1000);
         uint8_t msg_req27[] = {0xA6, 0x00, 27, 0x01, 0x00, 0x00, 0x00, 0x00};
-        SendBinary(msg_req27, 8);
+        QueueBinary(msg_req27, 8);
         
-        delay(1000);
         uint8_t msg_req29[] = {0xA6, 0x00, 29, 0x01, 0x00, 0x00, 0x00, 0x00};
-        SendBinary(msg_req29, 8);
-        
-        delay(1000);
-        uint8_t sbasParammsg[] = {170, 0, 0, 0, 0, 0};
-        SendBinary(sbasParammsg, 6);
+        QueueBinary(msg_req29, 8);
         
-        //delay(1000);
         //uint8_t msg_req[] = {0xA6, 0x01, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00};
-        //SendBinary(msg_req, 8);
+        //QueueBinary(msg_req, 8);
         
-        return 1;
+        uint8_t sbasParammsg[] = {170, 0, 0, 0, 0, 0};
+        return QueueBinary(sbasParammsg, 6);
     }
     
     void RequestFullPower(void)
@@ -693,7 +1041,7 @@ public:
 
     int8_t RequestTricklePower(void)
     {
-        if(gpsProtocol != GPS_BINARY) return -1;
+        if(linkProtocol != GPS_BINARY) return -1;
         
         uint8_t pwrMsg[16];
         
@@ -716,6 +1064,9 @@ public:
         
         return 1;
     }
+
+protected:
+    bool SendBaud(uint32_t rate) {return SendSiRFBaud(rate);}
 };
 
 #endif
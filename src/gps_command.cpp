@@ -0,0 +1,104 @@
+#include <gps_command.h>
+
+uint8_t GPSCommandQueue::Add(const uint8_t* data, uint8_t length, bool binary, uint8_t ack, uint16_t ackID, uint8_t protocol)
+{
+    if(count == GPS_COMMAND_SLOTS || length > GPS_COMMAND_LENGTH) return 0;
+
+    GPSCommand& command = commands[(head + count) % GPS_COMMAND_SLOTS];
+    memcpy(command.data, data, length);
+    command.length = length;
+    command.binary = binary;
+    command.ack = ack;
+    command.ackID = ackID;
+    command.protocol = protocol;
+    command.tries = 0;
+    command.status = GPS_COMMAND_QUEUED;
+
+    command.ticket = nextTicket++;
+    if(!nextTicket) nextTicket = 1;
+
+    count++;
+    return command.ticket;
+}
+
+uint8_t GPSCommandQueue::AddNMEA(const char* body, uint8_t protocol) //body is without '$' and the checksum, e.g., "PMTK220,200"
+{
+    size_t length = strlen(body);
+    if(length > GPS_COMMAND_LENGTH) return 0; //before it's narrowed: a 260-byte body would pass as 4
+
+    bool pmtk = !strncmp(body, "PMTK", 4);
+    return Add((const uint8_t*)body, length, false, pmtk ? GPS_ACK_PMTK : GPS_ACK_NONE, pmtk ? atoi(body + 4) : 0, protocol);
+}
+
+uint8_t GPSCommandQueue::AddBinary(const uint8_t* payload, uint8_t length, bool acknowledged, uint8_t protocol)
+{
+    return Add(payload, length, true, acknowledged ? GPS_ACK_SIRF : GPS_ACK_NONE, payload[0], protocol);
+}
+
+GPSCommand* GPSCommandQueue::Next(uint32_t now)
+{
+    if(!count) return nullptr;
+
+    GPSCommand& command = commands[head];
+    if(command.status == GPS_COMMAND_SENT)
+    {
+        if(now - command.sentAt < timeout) return nullptr;
+
+        if(command.tries > retries)
+        {
+            Finish(GPS_COMMAND_TIMEOUT);
+            return Next(now);
+        }
+    }
+
+    return &command;
+}
+
+void GPSCommandQueue::Sent(uint32_t now)
+{
+    GPSCommand& command = commands[head];
+    command.tries++;
+    command.sentAt = now;
+
+    if(command.ack == GPS_ACK_NONE) Finish(GPS_COMMAND_DONE);
+    else command.status = GPS_COMMAND_SENT;
+}
+
+void GPSCommandQueue::Acknowledge(uint8_t ack, uint16_t id, bool accepted)
+/*
+ * Acknowledgements that don't match the command we're waiting on (late ones for a
+ * command that already timed out, or for a command someone else sent) are ignored.
+ */
+{
+    if(Awaiting(ack) && commands[head].ackID == id) Finish(accepted ? GPS_COMMAND_DONE : GPS_COMMAND_REJECTED);
+}
+
+void GPSCommandQueue::Finish(uint8_t status)
+{
+    GPSCommand& command = commands[head];
+    command.status = status;
+
+    head = (head + 1) % GPS_COMMAND_SLOTS;
+    count--;
+
+    if(handler) handler(command.ticket, status, context);
+}
+
+uint8_t GPSCommandQueue::GetStatus(uint8_t ticket) const
+{
+    for(uint8_t i = 0; i < GPS_COMMAND_SLOTS; i++)
+        if(ticket && commands[i].ticket == ticket) return commands[i].status;
+
+    return GPS_COMMAND_UNKNOWN;
+}
+
+void GPSCommandQueue::Clear(void)
+{
+    for(uint8_t i = 0; i < count; i++) commands[(head + i) % GPS_COMMAND_SLOTS].status = GPS_COMMAND_UNKNOWN;
+    count = 0;
+}
+
+void GPSCommandQueue::Drop(void)
+{
+    while(count) Finish(GPS_COMMAND_DROPPED);
+}
@@ -0,0 +1,107 @@
+#ifndef __GPS_COMMAND_H
+#define __GPS_COMMAND_H
+
+#include <Arduino.h>
+
+#ifndef GPS_COMMAND_SLOTS
+#define GPS_COMMAND_SLOTS 6 //commands queued or recently finished
+#endif
+
+#ifndef GPS_COMMAND_LENGTH
+#define GPS_COMMAND_LENGTH 48 //NMEA body (PMTK314 is 46) or binary payload
+#endif
+
+#ifndef GPS_COMMAND_WAIT
+#define GPS_COMMAND_WAIT 1000 //ms to wait for an acknowledgement
+#endif
+
+#ifndef GPS_COMMAND_RETRIES
+#define GPS_COMMAND_RETRIES 2 //resends after the first try
+#endif
+
+#ifndef GPS_ACKS
+#define GPS_ACKS 4 //acknowledgements heard but not yet matched to the queue; a power of two
+#endif
+
+enum GPS_COMMAND_STATUS {GPS_COMMAND_UNKNOWN, GPS_COMMAND_QUEUED, GPS_COMMAND_SENT, GPS_COMMAND_DONE, GPS_COMMAND_REJECTED, GPS_COMMAND_TIMEOUT, GPS_COMMAND_DROPPED};
+
+//what a command is acknowledged with
+enum GPS_ACK {GPS_ACK_NONE, GPS_ACK_PMTK, GPS_ACK_SIRF};
+
+struct GPSAck //an acknowledgement as the parser heard it, on its way to Acknowledge()
+{
+    uint8_t ack; //a GPS_ACK
+    uint16_t id;
+    bool accepted;
+};
+
+typedef void (*GPSCommandHandler)(uint8_t ticket, uint8_t status, void* context); //status is a GPS_COMMAND_STATUS
+
+struct GPSCommand
+{
+    uint8_t ticket = 0;
+    uint8_t status = GPS_COMMAND_UNKNOWN;
+
+    bool binary = false; //data is a SiRF payload (MID first) rather than the body of a sentence
+    uint8_t length = 0;
+    uint8_t data[GPS_COMMAND_LENGTH];
+
+    uint8_t ack = GPS_ACK_NONE;
+    uint16_t ackID = 0; //the PMTK command number or the MID
+    uint8_t protocol = 0; //the GPS_PROTOCOL the receiver speaks once this is sent, or 0 if it doesn't change
+
+    uint8_t tries = 0;
+    uint32_t sentAt = 0;
+};
+
+class GPSCommandQueue
+/*
+ * Configuration commands, sent one at a time from the poll loop instead of with delay()s
+ * between them. The head command is sent, then waits for its acknowledgement -- PMTK001
+ * for PMTK commands, MID 11 (or 12, NACK) for SiRF binary ones -- and is resent if none
+ * comes within the timeout. Commands that aren't acknowledged (PSRF) are done once sent.
+ *
+ * Add() returns a ticket (never 0) for GetStatus() and the completion handler. Finished
+ * commands keep their status until their slot is reused.
+ */
+{
+protected:
+    GPSCommand commands[GPS_COMMAND_SLOTS];
+    uint8_t head = 0; //the command being sent
+    uint8_t count = 0; //queued, from head on
+    uint8_t nextTicket = 1;
+
+    uint16_t timeout = GPS_COMMAND_WAIT;
+    uint8_t retries = GPS_COMMAND_RETRIES;
+
+    GPSCommandHandler handler = nullptr;
+    void* context = nullptr;
+
+    void Finish(uint8_t status);
+
+public:
+    uint8_t Add(const uint8_t* data, uint8_t length, bool binary, uint8_t ack, uint16_t ackID, uint8_t protocol = 0);
+    uint8_t AddNMEA(const char* body, uint8_t protocol = 0); //acknowledged if it's PMTK
+    uint8_t AddBinary(const uint8_t* payload, uint8_t length, bool acknowledged = true, uint8_t protocol = 0);
+
+    GPSCommand* Next(uint32_t now); //the command to send (or resend) now, if any; call Sent() once it's out
+    void Sent(uint32_t now);
+    void Acknowledge(uint8_t ack, uint16_t id, bool accepted);
+
+    uint8_t GetStatus(uint8_t ticket) const;
+    uint8_t Free(void) const {return GPS_COMMAND_SLOTS - count;}
+    uint8_t Pending(void) const {return count;}
+    bool Awaiting(uint8_t ack) const {return count && commands[head].status == GPS_COMMAND_SENT && commands[head].ack == ack;}
+
+    void OnComplete(GPSCommandHandler h, void* c = nullptr)
+    {
+        handler = h;
+        context = c;
+    }
+
+    void SetTimeout(uint16_t ms, uint8_t resends) {timeout = ms; retries = resends;}
+    void Clear(void); //drops everything queued, without calling the handler
+    void Drop(void); //drops everything queued, finishing each as GPS_COMMAND_DROPPED
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include <gps_fence.h>
+
+static void Bounds(const GPSFenceSet& set, uint16_t first, uint16_t last, GPSFencePoint& low, GPSFencePoint& high) //vertices[first .. last - 1]
+{
+    low.lat = low.lon = INT32_MAX;
+    high.lat = high.lon = INT32_MIN;
+
+    for(uint16_t i = first; i < last; i++)
+    {
+        const GPSFencePoint& v = set.vertices[i];
+        if(v.lat < low.lat) low.lat = v.lat;
+        if(v.lat > high.lat) high.lat = v.lat;
+        if(v.lon < low.lon) low.lon = v.lon;
+        if(v.lon > high.lon) high.lon = v.lon;
+    }
+}
+
+uint16_t GPSFenceIndex(GPSFenceSet& set, uint16_t rows, uint16_t cols, uint16_t* cells, uint16_t* entries, uint16_t maxEntries)
+/*
+ * The grid just covers every vertex. Each polygon is listed in every cell its bounding
+ * box touches, so a cell's list is a superset of the polygons that overlap it. cells[]
+ * needs rows * cols + 1 slots.
+ */
+{
+    set.entries = nullptr;
+    if(!set.polygonCount || !rows || !cols) return 0;
+
+    GPSFencePoint low, high;
+    Bounds(set, 0, set.polygons[set.polygonCount], low, high);
+
+    set.lat0 = low.lat;
+    set.lon0 = low.lon;
+    set.cellLat = (uint32_t)(high.lat - low.lat) / rows + 1;
+    set.cellLon = (uint32_t)(high.lon - low.lon) / cols + 1;
+    set.rows = rows;
+    set.cols = cols;
+    set.cells = cells;
+
+    uint16_t cellCount = rows * cols;
+    for(uint16_t k = 0; k <= cellCount; k++) cells[k] = 0;
+
+    //two passes: count each cell's polygons into cells[k + 1], then lay them out
+    for(uint8_t pass = 0; pass < 2; pass++)
+    {
+        for(uint16_t p = 0; p < set.polygonCount; p++)
+        {
+            Bounds(set, set.polygons[p], set.polygons[p + 1], low, high);
+
+            uint16_t row0 = (low.lat - set.lat0) / set.cellLat, row1 = (high.lat - set.lat0) / set.cellLat;
+            uint16_t col0 = (low.lon - set.lon0) / set.cellLon, col1 = (high.lon - set.lon0) / set.cellLon;
+
+            for(uint16_t row = row0; row <= row1; row++)
+                for(uint16_t col = col0; col <= col1; col++)
+                {
+                    uint16_t k = row * cols + col;
+                    if(pass == 0) cells[k + 1]++;
+                    else entries[cells[k]++] = p;
+                }
+        }
+
+        if(pass == 0)
+        {
+            for(uint16_t k = 0; k < cellCount; k++) cells[k + 1] += cells[k];
+            if(cells[cellCount] > maxEntries) return cells[cellCount];
+        }
+    }
+
+    //filling moved each cells[k] up to the start of k + 1
+    for(uint16_t k = cellCount; k > 0; k--) cells[k] = cells[k - 1];
+    cells[0] = 0;
+
+    set.entries = entries;
+    return cells[cellCount];
+}
+
+bool GPSFenceContains(const GPSFenceSet& set, uint16_t polygon, int32_t lat, int32_t lon)
+/*
+ * Counts the edges that cross the parallel through the point to its east. Which side of
+ * an edge the point is on comes from a cross product, so there's no division.
+ */
+{
+    const GPSFencePoint* v = set.vertices + set.polygons[polygon];
+    uint16_t n = set.polygons[polygon + 1] - set.polygons[polygon];
+    if(n < 3) return false;
+
+    bool inside = false;
+    for(uint16_t i = 0, j = n - 1; i < n; j = i++)
+    {
+        const GPSFencePoint& a = v[j];
+        const GPSFencePoint& b = v[i];
+        if((a.lat > lat) == (b.lat > lat)) continue;
+
+        int64_t cross = (int64_t)(lon - a.lon) * (b.lat - a.lat) - (int64_t)(lat - a.lat) * (b.lon - a.lon);
+        if(b.lat > a.lat ? cross < 0 : cross > 0) inside = !inside;
+    }
+
+    return inside;
+}
+
+uint16_t GPSGeofence::Locate(int32_t lat, int32_t lon, uint16_t* found, uint8_t max) const
+{
+    if(!set.entries || lat < set.lat0 || lon < set.lon0) return 0;
+
+    uint32_t row = (uint32_t)(lat - set.lat0) / set.cellLat;
+    uint32_t col = (uint32_t)(lon - set.lon0) / set.cellLon;
+    if(row >= set.rows || col >= set.cols) return 0;
+
+    uint16_t cell = row * set.cols + col;
+    uint16_t count = 0;
+    for(uint16_t i = set.cells[cell]; i < set.cells[cell + 1]; i++)
+    {
+        if(!GPSFenceContains(set, set.entries[i], lat, lon)) continue;
+
+        if(count < max) found[count] = set.entries[i];
+        count++;
+    }
+
+    return count;
+}
+
+uint8_t GPSGeofence::Update(const GPSDatum& datum)
+{
+    uint8_t events = 0;
+
+    if(datum.gpsFix)
+    {
+        uint16_t was[GPS_FENCE_INSIDE];
+        uint8_t wasCount = insideCount;
+        memcpy(was, inside, sizeof(was));
+
+        uint16_t count = Locate(datum.lat, datum.lon, inside, GPS_FENCE_INSIDE);
+        if(count > GPS_FENCE_INSIDE)
+        {
+            count = GPS_FENCE_INSIDE;
+            overflow++;
+        }
+
+        insideCount = count;
+
+        //both lists ascend, so one walk through them finds what changed, in polygon order
+        uint8_t i = 0, j = 0;
+        while(i < wasCount || j < insideCount)
+        {
+            uint16_t polygon;
+            bool entered;
+
+            if(j == insideCount || (i < wasCount && was[i] < inside[j]))
+            {
+                polygon = was[i++];
+                entered = false;
+            }
+
+            else if(i == wasCount || inside[j] < was[i])
+            {
+                polygon = inside[j++];
+                entered = true;
+            }
+
+            else
+            {
+                i++;
+                j++;
+                continue;
+            }
+
+            events++;
+            if(changeHandler) changeHandler(polygon, entered, datum, changeContext);
+        }
+    }
+
+    if(datumHandler) datumHandler(datum, datumContext);
+
+    return events;
+}
+
+bool GPSGeofence::IsInside(uint16_t polygon) const
+{
+    for(uint8_t i = 0; i < insideCount; i++)
+        if(inside[i] == polygon) return true;
+
+    return false;
+}
+
+void GPSFenceDatum(const GPSDatum& datum, void* fence)
+{
+    ((GPSGeofence*)fence)->Update(datum);
+}
@@ -0,0 +1,99 @@
+#ifndef __GPS_FENCE_H
+#define __GPS_FENCE_H
+
+#include <gps.h>
+
+/*
+ * Geofences: polygons in DMM, like GPSDatum, with a uniform grid over them so that a fix
+ * is only tested against the polygons whose bounding boxes overlap its cell. Everything
+ * a GPSFenceSet points to can be const arrays in flash: the index is either built at
+ * startup with GPSFenceIndex() into RAM, or ahead of time with extras/host/gps_fencegen,
+ * which writes it all out as a header.
+ *
+ * Polygons are closed implicitly (don't repeat the first vertex) and may be concave, but
+ * shouldn't cross themselves or the 180th meridian.
+ */
+
+struct GPSFencePoint
+{
+    int32_t lat; //DMM
+    int32_t lon;
+};
+
+struct GPSFenceSet
+{
+    const GPSFencePoint* vertices;
+    const uint16_t* polygons; //polygonCount + 1 offsets into vertices; polygon i is vertices[polygons[i]] .. vertices[polygons[i + 1] - 1]
+    uint16_t polygonCount;
+
+    //rows x cols cells, each cellLat x cellLon DMM, from (lat0, lon0) at the SW corner
+    int32_t lat0, lon0;
+    uint32_t cellLat, cellLon;
+    uint16_t rows, cols;
+    const uint16_t* cells; //rows * cols + 1 offsets into entries; cell (row, col) is row * cols + col
+    const uint16_t* entries; //for each cell, in order, the polygons that overlap it
+};
+
+//fills in the grid of set, which must have its polygons; returns the number of entries it
+//needs, and the index is only usable if that's no more than maxEntries
+uint16_t GPSFenceIndex(GPSFenceSet& set, uint16_t rows, uint16_t cols, uint16_t* cells, uint16_t* entries, uint16_t maxEntries);
+
+bool GPSFenceContains(const GPSFenceSet& set, uint16_t polygon, int32_t lat, int32_t lon); //crossing test
+
+typedef void (*GPSFenceHandler)(uint16_t polygon, bool entered, const GPSDatum& datum, void* context);
+
+#ifndef GPS_FENCE_INSIDE
+#define GPS_FENCE_INSIDE 8 //the most polygons a fix is tracked as being inside at once
+#endif
+
+class GPSGeofence
+/*
+ * Follows fixes through a GPSFenceSet and reports each polygon entered or left, e.g.,
+ *   gps.OnEpoch(GPSFenceDatum, &fence);
+ *   fence.OnChange(Alarm);
+ *   fence.OnDatum(Log); //fixes are passed on after their events
+ * Datums without a fix are passed on without changing anything.
+ */
+{
+protected:
+    const GPSFenceSet& set;
+
+    uint16_t inside[GPS_FENCE_INSIDE]; //ascending
+    uint8_t insideCount = 0;
+    uint16_t overflow = 0;
+
+    GPSFenceHandler changeHandler = nullptr;
+    void* changeContext = nullptr;
+    GPSDatumHandler datumHandler = nullptr;
+    void* datumContext = nullptr;
+
+public:
+    GPSGeofence(const GPSFenceSet& fences) : set(fences) {}
+
+    void OnChange(GPSFenceHandler handler, void* context = nullptr)
+    {
+        changeHandler = handler;
+        changeContext = context;
+    }
+
+    void OnDatum(GPSDatumHandler handler, void* context = nullptr)
+    {
+        datumHandler = handler;
+        datumContext = context;
+    }
+
+    uint8_t Update(const GPSDatum& datum); //returns the number of polygons entered or left
+
+    //polygons containing (lat, lon), ascending; returns how many there are, even if more than max
+    uint16_t Locate(int32_t lat, int32_t lon, uint16_t* found, uint8_t max) const;
+
+    bool IsInside(uint16_t polygon) const;
+    uint8_t GetInside(const uint16_t*& polygons) const {polygons = inside; return insideCount;}
+    uint16_t GetOverflowCount(void) const {return overflow;} //fixes inside more than GPS_FENCE_INSIDE polygons
+
+    void Reset(void) {insideCount = 0;} //forgets where we are, without events
+};
+
+void GPSFenceDatum(const GPSDatum& datum, void* fence); //a GPSDatumHandler for a GPSGeofence
+
+#endif
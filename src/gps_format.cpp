@@ -0,0 +1,77 @@
+#include <gps.h>
+
+uint16_t GPSDatum::FormatCSV(char* buf, uint16_t size) const
+/*
+ * timestamp,fix,hh:mm:ss,lat,lon,elev -- lat/lon in DMM, elevation in m -- or just "0"
+ * without a fix
+ */
+{
+    GPSWriter out(buf, size);
+
+    if(!gpsFix) out.Char('0');
+    else
+    {
+        out.UInt(timestamp).Char(',').UInt(gpsFix).Char(',');
+        out.UInt(hour, 2).Char(':').UInt(minute, 2).Char(':').UInt(second, 2).Char(',');
+        out.Int(lat).Char(',').Int(lon).Char(',').Fixed(elevDM, 1);
+    }
+
+    return out.Finish();
+}
+
+uint16_t GPSDatum::FormatShortCSV(char* buf, uint16_t size) const //hh:mm:ss,elev
+{
+    GPSWriter out(buf, size);
+
+    out.UInt(hour, 2).Char(':').UInt(minute, 2).Char(':').UInt(second, 2).Char(',');
+    out.Fixed(elevDM * 10, 2);
+
+    return out.Finish();
+}
+
+void GPSDatum::WriteISOTime(GPSWriter& out) const
+{
+    out.UInt(GPSFullYear(year), 4).Char('-').UInt(month, 2).Char('-').UInt(day, 2).Char('T');
+    out.UInt(hour, 2).Char(':').UInt(minute, 2).Char(':').UInt(second, 2).Char('.').UInt(msec, 3).Char('Z');
+}
+
+uint16_t GPSDatum::FormatISOTime(char* buf, uint16_t size) const
+/*
+ * yyyy-mm-ddThh:mm:ss.sssZ, with the century from GPSFullYear(); the date is whatever
+ * RMC/ZDA gave us (2000-00-00 if neither has come in)
+ */
+{
+    GPSWriter out(buf, size);
+    WriteISOTime(out);
+
+    return out.Finish();
+}
+
+uint16_t GPSDatum::FormatDegrees(char* buf, uint16_t size) const //lat,lon in decimal degrees
+{
+    GPSWriter out(buf, size);
+
+    out.Degrees(lat).Char(',').Degrees(lon);
+
+    return out.Finish();
+}
+
+uint16_t GPSDatum::FormatJSON(char* buf, uint16_t size) const
+/*
+ * One line of JSON (no newline), with speed in m/s, e.g.,
+ * {"time":"2026-03-17T12:34:56.789Z","lat":42.205000,"lon":-71.800000,"elev":54.5,"fix":1,
+ *  "sats":7,"hdop":1.00,"speed":0.06,"course":309.62,"src":3}
+ */
+{
+    GPSWriter out(buf, size);
+
+    out.Str("{\"time\":\"");
+    WriteISOTime(out);
+    out.Str("\",\"lat\":").Degrees(lat).Str(",\"lon\":").Degrees(lon);
+    out.Str(",\"elev\":").Fixed(elevDM, 1).Str(",\"fix\":").UInt(gpsFix);
+    out.Str(",\"sats\":").UInt(satsUsed).Str(",\"hdop\":").Fixed(hdop, 2);
+    out.Str(",\"speed\":").Fixed(speedCMS, 2).Str(",\"course\":").Fixed(courseCD, 2);
+    out.Str(",\"src\":").UInt(source).Char('}');
+
+    return out.Finish();
+}
@@ -0,0 +1,109 @@
+#ifndef __GPS_FORMAT_H
+#define __GPS_FORMAT_H
+
+#include <Arduino.h>
+
+class GPSWriter
+/*
+ * Appends text to a caller's buffer using integer arithmetic only, so formatting a fix
+ * doesn't pull in printf and its float support. The buffer is always null-terminated.
+ * Once something doesn't fit, the rest is dropped and Finish() reports 0 (and leaves
+ * the buffer empty) rather than handing back a truncated line.
+ */
+{
+protected:
+    char* buf;
+    uint16_t size;
+    uint16_t length = 0;
+    bool overflow = false;
+
+public:
+    GPSWriter(char* b, uint16_t s) : buf(b), size(s)
+    {
+        if(size) buf[0] = 0;
+        else overflow = true;
+    }
+
+    GPSWriter& Char(char c)
+    {
+        if(length + 1 < size)
+        {
+            buf[length++] = c;
+            buf[length] = 0;
+        }
+
+        else overflow = true;
+
+        return *this;
+    }
+
+    GPSWriter& Str(const char* str)
+    {
+        while(*str) Char(*str++);
+        return *this;
+    }
+
+    GPSWriter& UInt(uint32_t value, uint8_t width = 0) //zero-padded to width
+    {
+        char digits[10];
+        uint8_t n = 0;
+        do
+        {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        } while(value);
+
+        for(; width > n; width--) Char('0');
+        while(n) Char(digits[--n]);
+
+        return *this;
+    }
+
+    GPSWriter& Int(int32_t value)
+    {
+        if(value < 0) Char('-');
+        return UInt(value < 0 ? -(uint32_t)value : value);
+    }
+
+    GPSWriter& Fixed(int32_t value, uint8_t decimals) //value / 10^decimals, e.g., Fixed(-5, 1) gives "-0.5"
+    {
+        uint32_t scale = 1;
+        for(uint8_t i = 0; i < decimals; i++) scale *= 10;
+
+        uint32_t magnitude = value < 0 ? -(uint32_t)value : value;
+        if(value < 0) Char('-');
+
+        UInt(magnitude / scale);
+        if(decimals)
+        {
+            Char('.');
+            UInt(magnitude % scale, decimals);
+        }
+
+        return *this;
+    }
+
+    GPSWriter& Degrees(int32_t dmm) //decimilliminutes as decimal degrees, to 6 places (DMM resolution is 1.7e-6)
+    {
+        uint32_t magnitude = dmm < 0 ? -(uint32_t)dmm : dmm;
+        if(dmm < 0) Char('-');
+
+        uint32_t micro = (magnitude * 5 + 1) / 3; //microdegrees, rounded
+        UInt(micro / 1000000);
+        Char('.');
+        return UInt(micro % 1000000, 6);
+    }
+
+    uint16_t Finish(void) //length written, or 0 if it didn't fit
+    {
+        if(overflow)
+        {
+            length = 0;
+            if(size) buf[0] = 0;
+        }
+
+        return length;
+    }
+};
+
+#endif
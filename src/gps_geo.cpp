@@ -0,0 +1,271 @@
+#include <gps_geo.h>
+
+//sin(i * 90 / 256 degrees), Q30
+static const int32_t sinTable[GEO_TABLE_SIZE + 1] =
+{
+    0, 6588356, 13176464, 19764076, 26350943, 32936819, 39521455, 46104602,
+    52686014, 59265442, 65842639, 72417357, 78989349, 85558366, 92124163, 98686491,
+    105245103, 111799753, 118350194, 124896179, 131437462, 137973796, 144504935, 151030634,
+    157550647, 164064728, 170572633, 177074115, 183568930, 190056834, 196537583, 203010932,
+    209476638, 215934457, 222384147, 228825464, 235258165, 241682010, 248096755, 254502159,
+    260897982, 267283981, 273659918, 280025552, 286380643, 292724951, 299058239, 305380268,
+    311690799, 317989595, 324276419, 330551034, 336813204, 343062693, 349299266, 355522689,
+    361732726, 367929144, 374111709, 380280190, 386434353, 392573967, 398698801, 404808624,
+    410903207, 416982319, 423045732, 429093217, 435124548, 441139496, 447137835, 453119340,
+    459083786, 465030947, 470960600, 476872522, 482766489, 488642281, 494499676, 500338453,
+    506158392, 511959275, 517740883, 523502998, 529245404, 534967884, 540670223, 546352205,
+    552013618, 557654248, 563273883, 568872310, 574449320, 580004702, 585538248, 591049748,
+    596538995, 602005783, 607449906, 612871159, 618269338, 623644239, 628995660, 634323400,
+    639627258, 644907034, 650162530, 655393548, 660599890, 665781362, 670937767, 676068911,
+    681174602, 686254647, 691308855, 696337036, 701339000, 706314559, 711263525, 716185713,
+    721080937, 725949013, 730789757, 735602987, 740388522, 745146182, 749875788, 754577161,
+    759250125, 763894504, 768510122, 773096806, 777654384, 782182683, 786681534, 791150767,
+    795590213, 799999706, 804379079, 808728167, 813046808, 817334838, 821592095, 825818421,
+    830013654, 834177638, 838310216, 842411232, 846480531, 850517961, 854523370, 858496606,
+    862437520, 866345964, 870221790, 874064853, 877875009, 881652112, 885396022, 889106597,
+    892783698, 896427186, 900036924, 903612776, 907154608, 910662286, 914135678, 917574653,
+    920979082, 924348837, 927683790, 930983817, 934248793, 937478595, 940673101, 943832191,
+    946955747, 950043650, 953095785, 956112036, 959092290, 962036435, 964944360, 967815955,
+    970651112, 973449725, 976211688, 978936898, 981625251, 984276646, 986890984, 989468165,
+    992008094, 994510675, 996975812, 999403415, 1001793390, 1004145648, 1006460100, 1008736660,
+    1010975242, 1013175761, 1015338134, 1017462281, 1019548121, 1021595575, 1023604567, 1025575020,
+    1027506862, 1029400018, 1031254418, 1033069992, 1034846671, 1036584389, 1038283080, 1039942680,
+    1041563127, 1043144360, 1044686319, 1046188946, 1047652185, 1049075980, 1050460278, 1051805027,
+    1053110176, 1054375676, 1055601479, 1056787540, 1057933813, 1059040255, 1060106826, 1061133483,
+    1062120190, 1063066909, 1063973603, 1064840240, 1065666786, 1066453210, 1067199483, 1067905576,
+    1068571464, 1069197120, 1069782521, 1070327646, 1070832474, 1071296985, 1071721163, 1072104991,
+    1072448455, 1072751542, 1073014240, 1073236540, 1073418433, 1073559913, 1073660973, 1073721611,
+    1073741824
+};
+
+//atan(i / 256), binary angle
+static const int32_t atanTable[GEO_TABLE_SIZE + 1] =
+{
+    0, 2670163, 5340245, 8010164, 10679838, 13349187, 16018129, 18686582,
+    21354465, 24021698, 26688200, 29353889, 32018685, 34682507, 37345276, 40006910,
+    42667331, 45326458, 47984212, 50640513, 53295284, 55948444, 58599915, 61249621,
+    63897482, 66543421, 69187361, 71829226, 74468939, 77106424, 79741605, 82374407,
+    85004756, 87632577, 90257796, 92880340, 95500135, 98117110, 100731191, 103342309,
+    105950391, 108555367, 111157167, 113755721, 116350962, 118942819, 121531227, 124116117,
+    126697423, 129275078, 131849018, 134419178, 136985493, 139547900, 142106335, 144660738,
+    147211045, 149757197, 152299132, 154836791, 157370116, 159899047, 162423527, 164943499,
+    167458907, 169969696, 172475810, 174977196, 177473799, 179965568, 182452450, 184934394,
+    187411349, 189883266, 192350096, 194811789, 197268300, 199719579, 202165583, 204606264,
+    207041579, 209471483, 211895933, 214314887, 216728303, 219136141, 221538359, 223934919,
+    226325781, 228710908, 231090262, 233463808, 235831508, 238193329, 240549235, 242899194,
+    245243172, 247581137, 249913059, 252238905, 254558647, 256872255, 259179700, 261480955,
+    263775993, 266064788, 268347313, 270623543, 272893455, 275157025, 277414230, 279665048,
+    281909457, 284147437, 286378966, 288604026, 290822599, 293034664, 295240206, 297439207,
+    299631651, 301817523, 303996806, 306169488, 308335554, 310494991, 312647786, 314793928,
+    316933406, 319066208, 321192324, 323311746, 325424463, 327530468, 329629752, 331722309,
+    333808132, 335887214, 337959550, 340025134, 342083962, 344136031, 346181336, 348219874,
+    350251643, 352276640, 354294865, 356306316, 358310992, 360308894, 362300021, 364284375,
+    366261957, 368232767, 370196809, 372154086, 374104599, 376048352, 377985350, 379915596,
+    381839095, 383755852, 385665872, 387569162, 389465727, 391355574, 393238710, 395115141,
+    396984877, 398847924, 400704291, 402553986, 404397019, 406233399, 408063135, 409886237,
+    411702716, 413512582, 415315845, 417112518, 418902610, 420686135, 422463104, 424233528,
+    425997422, 427754796, 429505665, 431250041, 432987938, 434719370, 436444350, 438162893,
+    439875013, 441580724, 443280042, 444972981, 446659557, 448339785, 450013680, 451681259,
+    453342536, 454997530, 456646255, 458288728, 459924966, 461554985, 463178803, 464796437,
+    466407904, 468013221, 469612406, 471205476, 472792449, 474373344, 475948178, 477516969,
+    479079736, 480636498, 482187271, 483732076, 485270931, 486803855, 488330866, 489851983,
+    491367227, 492876615, 494380167, 495877903, 497369841, 498856002, 500336404, 501811068,
+    503280012, 504743258, 506200824, 507652730, 509098996, 510539643, 511974689, 513404156,
+    514828063, 516246430, 517659277, 519066625, 520468494, 521864904, 523255875, 524641427,
+    526021581, 527396357, 528765775, 530129856, 531488619, 532842087, 534190278, 535533213,
+    536870912
+};
+
+int32_t GeoSin(uint32_t angle)
+/*
+ * sin(a + d) = sin(a)cos(d) + cos(a)sin(d), with a from the table and d under 0.36
+ * degrees, so two terms of the series for each of sin(d) and cos(d) are plenty. Linear
+ * interpolation would be off by up to 5e-6, which is 30 m once it goes through an asin.
+ */
+{
+    uint8_t quadrant = angle >> 30;
+    uint32_t x = angle & (GEO_ANGLE_90 - 1);
+    if(quadrant & 1) x = GEO_ANGLE_90 - x; //mirror for the 2nd and 4th quadrants
+
+    uint16_t i = x >> 22; //8 bits of index, 22 of remainder
+
+    int64_t d = ((int64_t)(x & 0x3fffff) * 1686629713) >> 30; //remainder in radians (Q30 pi/2 per 2^30)
+    int64_t d2 = (d * d) >> 30;
+    int64_t sinD = d - ((((d * d2) >> 30) * 43691) >> 18); //d^3 / 6, by reciprocal: it's under 2^9
+    int64_t cosD = (1LL << 30) - d2 / 2;
+
+    int32_t value = ((int64_t)sinTable[i] * cosD + (int64_t)sinTable[GEO_TABLE_SIZE - i] * sinD + (1LL << 29)) >> 30;
+
+    return quadrant & 2 ? -value : value;
+}
+
+static uint32_t Ratio(uint32_t num, uint32_t den)
+/*
+ * num / den in Q30, for num <= den < 2^31: long division a bit at a time, so that it
+ * stays in 32 bits (the M0 has no divider, and a 64-bit division is a slow library call)
+ */
+{
+    uint32_t q = 0;
+    if(num >= den) {num -= den; q = 1;}
+
+    for(uint8_t bit = 0; bit < 30; bit++)
+    {
+        num <<= 1; q <<= 1;
+        if(num >= den) {num -= den; q |= 1;}
+    }
+
+    return q;
+}
+
+int32_t GeoAtan2(int64_t y, int64_t x)
+/*
+ * atan(r) = atan(r0) + atan((r - r0) / (1 + r * r0)), with r0 from the table; the second
+ * term is under 1/256, so t - t^3/3 does for it
+ */
+{
+    if(!x && !y) return 0;
+
+    uint64_t ax = x < 0 ? -x : x;
+    uint64_t ay = y < 0 ? -y : y;
+
+    bool steep = ay > ax; //work in the first octant, where the ratio is <= 1
+    uint64_t num = steep ? ax : ay, den = steep ? ay : ax;
+
+    //Q30 ratio, in 32 bits: shift the operands down to 31 bits first (a ratio needs no more)
+    while(den >= (1ULL << 31)) {num >>= 1; den >>= 1;}
+    uint32_t ratio = Ratio(num, den);
+
+    uint16_t i = ratio >> 22;
+    uint32_t r0 = (uint32_t)i << 22;
+
+    int32_t t = Ratio(ratio - r0, (1UL << 30) + (((uint64_t)r0 * ratio) >> 30)); //Q30, under 2^22
+    t -= (((((int64_t)t * t) >> 30) * t >> 30) * 21846) >> 16; //t^3 / 3, by reciprocal: it's under 2^6
+
+    uint32_t angle = atanTable[i] + (((int64_t)t * 683565276 + (1LL << 29)) >> 30); //radians to binary angle: 2 / pi in Q30
+
+    if(steep) angle = GEO_ANGLE_90 - angle;
+    if(x < 0) angle = 2 * GEO_ANGLE_90 - angle;
+
+    return y < 0 ? -(int32_t)angle : (int32_t)angle;
+}
+
+uint32_t GeoSqrt(uint64_t n)
+{
+    uint64_t root = 0, bit = 1ULL << 62;
+    while(bit > n) bit >>= 2;
+
+    while(bit)
+    {
+        if(n >= root + bit)
+        {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else root >>= 1;
+
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+static int32_t WrapLon(int32_t dLon) //DMM difference, into +/-180 degrees
+{
+    if(dLon > GEO_DMM_PER_CIRCLE / 2) return dLon - GEO_DMM_PER_CIRCLE;
+    if(dLon < -GEO_DMM_PER_CIRCLE / 2) return dLon + GEO_DMM_PER_CIRCLE;
+    return dLon;
+}
+
+static uint32_t MetersFromAngle(uint32_t angle) {return ((uint64_t)angle * GEO_CIRCUMFERENCE + (1ULL << 31)) >> 32;}
+static uint32_t AngleFromMeters(uint32_t m) {return ((uint64_t)m * 3600158972UL) >> 25;} //2^57 / GEO_CIRCUMFERENCE
+
+uint32_t GeoDistanceFast(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+    //in sixteenths of a DMM, so that the root doesn't round off 0.2 m
+    int64_t dy = (int64_t)(lat2 - lat1) << 4;
+    int64_t dx = ((int64_t)WrapLon(lon2 - lon1) * GeoCos(GeoAngleFromDMM(lat1 / 2 + lat2 / 2))) >> 26;
+
+    return ((uint64_t)GeoSqrt(dx * dx + dy * dy) * 49747801 + (1ULL << 31)) >> 32; //0.185325 m per DMM, /16, in Q32
+}
+
+static uint32_t CentralAngle(uint32_t phi1, uint32_t phi2, int32_t dLambda) //haversine
+{
+    int64_t s1 = GeoSin((uint32_t)((int32_t)(phi2 - phi1) / 2));
+    int64_t s2 = GeoSin((uint32_t)(dLambda / 2));
+
+    //cos(phi) * sin(dLambda / 2) for each end, rather than rounding cos(phi1)cos(phi2) to Q30:
+    //near a pole that product is only a few units, and the east-west term went with it
+    int64_t t1 = ((int64_t)GeoCos(phi1) * s2 + (1LL << 29)) >> 30;
+    int64_t t2 = ((int64_t)GeoCos(phi2) * s2 + (1LL << 29)) >> 30;
+
+    uint64_t a = s1 * s1 + t1 * t2; //Q60, so short distances don't vanish
+    if(a > (1ULL << 60)) a = 1ULL << 60;
+
+    return 2 * (uint32_t)GeoAtan2(GeoSqrt(a), GeoSqrt((1ULL << 60) - a));
+}
+
+uint32_t GeoDistance(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+    return MetersFromAngle(CentralAngle(GeoAngleFromDMM(lat1), GeoAngleFromDMM(lat2), GeoAngleFromDMM(WrapLon(lon2 - lon1))));
+}
+
+static uint32_t BearingAngle(uint32_t phi1, uint32_t phi2, uint32_t dLambda)
+/*
+ * atan2(sin(dLambda)cos(phi2), cos(phi1)sin(phi2) - sin(phi1)cos(phi2)cos(dLambda)), with the
+ * second term rewritten as sin(phi2 - phi1) + sin(phi1)cos(phi2) * 2sin^2(dLambda / 2) so
+ * that short hops aren't the difference of two nearly equal numbers
+ */
+{
+    int64_t c2 = GeoCos(phi2);
+    int64_t s = GeoSin((uint32_t)((int32_t)dLambda / 2));
+    int64_t t = (c2 * s + (1LL << 29)) >> 30; //cos(phi2)sin(dLambda / 2), as in CentralAngle()
+    int64_t y = (int64_t)GeoSin(dLambda) * c2;
+    int64_t x = ((int64_t)GeoSin(phi2 - phi1) << 30) + 2 * ((((int64_t)GeoSin(phi1) * t) >> 30) * s);
+
+    return GeoAtan2(y, x);
+}
+
+uint16_t GeoBearing(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2)
+{
+    uint16_t cd = GeoCDFromAngle(BearingAngle(GeoAngleFromDMM(lat1), GeoAngleFromDMM(lat2), GeoAngleFromDMM(WrapLon(lon2 - lon1))));
+    return cd >= 36000 ? cd - 36000 : cd;
+}
+
+void GeoDestination(int32_t lat, int32_t lon, uint16_t bearingCD, uint32_t distance, int32_t& lat2, int32_t& lon2)
+/*
+ * cos(phi2)sin(dLambda) = sin(theta)sin(delta) and cos(phi2)cos(dLambda) = cos(phi1)cos(delta) -
+ * sin(phi1)sin(delta)cos(theta), so cos(phi2) is the root of their squares: near a pole, taking
+ * it from 1 - sin^2(phi2) (or dLambda from cos(delta) - sin(phi1)sin(phi2)) cancels away
+ */
+{
+    uint32_t phi1 = GeoAngleFromDMM(lat);
+    uint32_t theta = GeoAngleFromCD(bearingCD);
+    uint32_t delta = AngleFromMeters(distance);
+
+    int64_t sinPhi1 = GeoSin(phi1), cosPhi1 = GeoCos(phi1);
+    int64_t sinDelta = GeoSin(delta), cosDelta = GeoCos(delta);
+    int64_t sinTheta = GeoSin(theta), cosTheta = GeoCos(theta);
+
+    int64_t sinPhi2 = (sinPhi1 * cosDelta + ((cosPhi1 * sinDelta >> 30) * cosTheta) + (1LL << 29)) >> 30;
+
+    int64_t y = (sinTheta * sinDelta + (1LL << 29)) >> 30;
+    int64_t x = (cosPhi1 * cosDelta - ((sinPhi1 * sinDelta >> 30) * cosTheta) + (1LL << 29)) >> 30;
+
+    lat2 = GeoDMMFromAngle(GeoAtan2(sinPhi2, GeoSqrt(x * x + y * y)));
+    lon2 = WrapLon(lon + GeoDMMFromAngle(GeoAtan2(y, x)));
+}
+
+int32_t GeoCrossTrack(int32_t startLat, int32_t startLon, int32_t endLat, int32_t endLon, int32_t lat, int32_t lon)
+{
+    uint32_t phi1 = GeoAngleFromDMM(startLat), phi2 = GeoAngleFromDMM(endLat), phi3 = GeoAngleFromDMM(lat);
+    uint32_t dLambda12 = GeoAngleFromDMM(WrapLon(endLon - startLon)), dLambda13 = GeoAngleFromDMM(WrapLon(lon - startLon));
+
+    uint32_t delta13 = CentralAngle(phi1, phi3, dLambda13);
+    uint32_t theta12 = BearingAngle(phi1, phi2, dLambda12);
+    uint32_t theta13 = BearingAngle(phi1, phi3, dLambda13);
+
+    int64_t s = ((int64_t)GeoSin(delta13) * GeoSin(theta13 - theta12)) >> 30;
+    int32_t angle = GeoAtan2(s, GeoSqrt((1ULL << 60) - (uint64_t)(s * s))); //asin
+
+    return angle < 0 ? -(int32_t)MetersFromAngle(-angle) : MetersFromAngle(angle);
+}
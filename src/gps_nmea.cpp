@@ -0,0 +1,60 @@
+#include <gps_nmea.h>
+#include <limits.h>
+
+static long Shift(long value, uint8_t digit) //value * 10 + digit, stopping at LONG_MAX rather than overflowing
+{
+    return value > (LONG_MAX - digit) / 10 ? LONG_MAX : value * 10 + digit;
+}
+
+long NMEAField::ToFixed(uint8_t decimals) const
+/*
+ * Reads an optionally signed decimal as an integer scaled by 10^decimals, e.g., "-12.3"
+ * with decimals = 2 gives -1230, whatever the number of digits sent. Fractional digits
+ * beyond 'decimals' are truncated, and values out of a long's range are clamped to
+ * +/-LONG_MAX. Stops at the first character that doesn't belong, like String::toInt().
+ */
+{
+    uint8_t i = 0;
+    bool negative = false;
+    if(i < length && (str[i] == '-' || str[i] == '+')) negative = (str[i++] == '-');
+
+    long value = 0;
+    for(; i < length && str[i] >= '0' && str[i] <= '9'; i++)
+        value = Shift(value, str[i] - '0');
+
+    if(i < length && str[i] == '.') i++;
+
+    for(; decimals; decimals--) //once the digits run out, i stops moving and we pad with zeros
+    {
+        uint8_t digit = 0;
+        if(i < length && str[i] >= '0' && str[i] <= '9') digit = str[i++] - '0';
+        value = Shift(value, digit);
+    }
+
+    return negative ? -value : value;
+}
+
+uint8_t NMEATokenizer::Tokenize(const char* str, uint16_t length)
+{
+    sentence = str;
+    fieldCount = 0;
+
+    if(length > 254) length = 254; //offsets are stored as bytes; real sentences are < 83 chars
+
+    uint8_t i = (length && str[0] == '$') ? 1 : 0;
+    fieldStart[fieldCount++] = i;
+
+    for(; i < length; i++)
+    {
+        if(str[i] == '*') break;
+        if(str[i] == ',')
+        {
+            if(fieldCount == NMEA_MAX_FIELDS) break; //anything further is dropped
+            fieldStart[fieldCount++] = i + 1;
+        }
+    }
+
+    fieldStart[fieldCount] = i + 1;
+
+    return fieldCount;
+}
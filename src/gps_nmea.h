@@ -0,0 +1,212 @@
+#ifndef __GPS_NMEA_H
+#define __GPS_NMEA_H
+
+#include <Arduino.h>
+
+#define NMEA_MAX_FIELDS 24 //GSV is the longest we care about at 21 fields
+
+#define NMEA_MAX_LENGTH 82 //per the standard, '$' through <CR><LF>
+#define NMEA_LINE_CAPACITY (NMEA_MAX_LENGTH + 18) //slack for receivers that run long
+
+enum NMEA_LINE_STATE {LINE_WAITING, LINE_RECEIVING, LINE_COMPLETE, LINE_CHECKSUM_ERROR, LINE_OVERFLOW};
+
+inline int8_t NMEAHexDigit(char c) //-1 if c isn't a hex digit
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/*
+ * Sentence keys for switching on the type without string compares. Standard sentences
+ * are keyed on the three-letter formatter alone, so the talker ID (GP, GN, GL, GA, ...)
+ * doesn't matter; proprietary ones ('P' + maker) on the four characters after the 'P'.
+ * The two can't collide, since formatter keys are < 2^24.
+ */
+constexpr uint32_t NMEAKey(const char* str, uint8_t n = 3)
+{
+    return n ? (NMEAKey(str, n - 1) << 8) | (uint8_t)str[n - 1] : 0;
+}
+
+constexpr uint32_t NMEAProprietaryKey(const char* header) {return NMEAKey(header + 1, 4);} //e.g., "PMTK0"
+
+class NMEAField //non-owning view of one field of a sentence; not null-terminated!
+{
+public:
+    const char* str = nullptr;
+    uint8_t length = 0;
+
+public:
+    NMEAField(void) {}
+    NMEAField(const char* s, uint8_t len) : str(s), length(len) {}
+
+    bool IsEmpty(void) const {return length == 0;}
+    char operator[] (uint8_t i) const {return i < length ? str[i] : 0;}
+
+    bool operator == (char c) const {return length == 1 && str[0] == c;}
+    bool operator != (char c) const {return !(*this == c);}
+    bool Equals(const char* s) const
+    {
+        uint8_t i = 0;
+        for(; i < length; i++) if(s[i] != str[i]) return false;
+        return s[i] == 0;
+    }
+
+    int8_t IndexOf(char c) const
+    {
+        for(uint8_t i = 0; i < length; i++) if(str[i] == c) return i;
+        return -1;
+    }
+
+    NMEAField Sub(uint8_t start, uint8_t count = 255) const //clipped to the field
+    {
+        if(start > length) start = length;
+        if(count > length - start) count = length - start;
+        return NMEAField(str + start, count);
+    }
+
+    long ToFixed(uint8_t decimals) const;
+    long ToInt(void) const {return ToFixed(0);}
+    String ToString(void) const {return String(str ? str : "", length);}
+};
+
+inline uint32_t NMEASentenceKey(const NMEAField& header) //0 if it can't be a sentence header
+{
+    if(header.length < 5) return 0;
+    return header[0] == 'P' ? NMEAKey(header.str + 1, 4) : NMEAKey(header.str + 2, 3);
+}
+
+class NMEATokenizer
+/*
+ * Indexes the commas of a sentence in one pass. Fields are then handed out as views
+ * into the original buffer, so the buffer must outlive the tokenizer.
+ * Field 0 is the header (e.g., "GPGGA"); the leading '$' and the trailing "*hh" are
+ * not part of any field.
+ */
+{
+protected:
+    const char* sentence = nullptr;
+    uint8_t fieldCount = 0;
+    uint8_t fieldStart[NMEA_MAX_FIELDS + 1]; //last entry is one past the end of the last field
+
+public:
+    NMEATokenizer(void) {}
+    NMEATokenizer(const char* str, uint16_t length) {Tokenize(str, length);}
+
+    uint8_t Tokenize(const char* str, uint16_t length);
+    uint8_t FieldCount(void) const {return fieldCount;}
+
+    NMEAField operator[] (uint8_t i) const
+    {
+        if(i >= fieldCount) return NMEAField();
+        return NMEAField(sentence + fieldStart[i], fieldStart[i + 1] - fieldStart[i] - 1);
+    }
+};
+
+class NMEALineBuffer
+/*
+ * Assembles sentences one character at a time into a fixed buffer. A line starts at '$'
+ * and ends at '\n'; '\r' is dropped. A line that outgrows the buffer is discarded and
+ * nothing is stored until the next '$'. A '$' always starts a new line, so a line that
+ * lost its newline is dropped rather than glued to the next one.
+ *
+ * The checksum is accumulated as characters arrive and the two digits after '*' are
+ * decoded as they come in, so a line is reported as either LINE_COMPLETE (checksum
+ * good) or LINE_CHECKSUM_ERROR (bad or missing) the moment its newline is read.
+ *
+ * A completed line stays in place (null-terminated) until the next '$' arrives.
+ */
+{
+protected:
+    char line[NMEA_LINE_CAPACITY + 1];
+    uint8_t length = 0;
+    NMEA_LINE_STATE state = LINE_WAITING;
+
+    uint8_t checksum = 0; //running XOR of everything between '$' and '*'
+    uint8_t received = 0; //the checksum as sent
+    int8_t checksumDigits = -1; //-1 until '*' is seen; > 2 if what follows isn't a checksum
+
+    uint32_t startMicros = 0; //micros() when the line's '$' came in
+
+    uint16_t overflowCount = 0;
+    uint16_t skipCount = 0;
+
+public:
+    NMEALineBuffer(void) {line[0] = 0;}
+
+    NMEA_LINE_STATE AddChar(char c)
+    {
+        if(c == '$')
+        {
+            startMicros = micros();
+            line[0] = c;
+            length = 1;
+            checksum = received = 0;
+            checksumDigits = -1;
+            return state = LINE_RECEIVING;
+        }
+
+        if(state != LINE_RECEIVING) return state = LINE_WAITING;
+
+        if(c == '\n')
+        {
+            line[length] = 0;
+            return state = (checksumDigits == 2 && received == checksum) ? LINE_COMPLETE : LINE_CHECKSUM_ERROR;
+        }
+
+        if(c == '\r') return state;
+
+        if(length == NMEA_LINE_CAPACITY) //too long to be NMEA -- drop it and resync on the next '$'
+        {
+            length = 0;
+            line[0] = 0;
+            overflowCount++;
+            return state = LINE_OVERFLOW;
+        }
+
+        line[length++] = c;
+
+        if(checksumDigits < 0)
+        {
+            if(c == '*') checksumDigits = 0;
+            else checksum ^= c;
+        }
+
+        else
+        {
+            int8_t nibble = NMEAHexDigit(c);
+            if(nibble < 0 || checksumDigits >= 2) checksumDigits = 3;
+            else
+            {
+                received = (received << 4) | nibble;
+                checksumDigits++;
+            }
+        }
+
+        return state;
+    }
+
+    void Reset(void) {length = 0; line[0] = 0; state = LINE_WAITING;}
+
+    const char* GetLine(void) const {return line;}
+    uint8_t Length(void) const {return length;}
+    uint32_t StartMicros(void) const {return startMicros;}
+    NMEA_LINE_STATE GetState(void) const {return state;}
+    uint16_t GetOverflowCount(void) const {return overflowCount;}
+
+    //once Length() reaches 6, the key of the sentence type (see NMEASentenceKey())
+    uint32_t HeaderKey(void) const {return length >= 6 ? NMEASentenceKey(NMEAField(line + 1, 5)) : 0;}
+
+    void Skip(void) //drop the line being received; nothing more is stored until the next '$'
+    {
+        length = 0;
+        line[0] = 0;
+        state = LINE_WAITING;
+        skipCount++;
+    }
+
+    uint16_t GetSkipCount(void) const {return skipCount;}
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __GPS_QUEUE_H
+#define __GPS_QUEUE_H
+
+#include <Arduino.h>
+
+//keeps the compiler from moving memory accesses across it; enough on a single-core M0+
+#define GPS_COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+template <class T, uint16_t N> class SPSCQueue
+/*
+ * Lock-free queue between exactly one producer (e.g., a UART interrupt) and one consumer
+ * (e.g., loop()). Each index is written by one side only, so neither side ever waits or
+ * has to mask interrupts. The indices run free and are masked on use, so all N slots
+ * are usable; N must be a power of two.
+ *
+ * On a part with a cache or a second core, the barriers would need to be real ones
+ * (__DMB()).
+ */
+{
+    static_assert(N && !(N & (N - 1)) && N <= 32768, "SPSCQueue size must be a power of two <= 32768");
+
+protected:
+    T items[N];
+
+    volatile uint16_t head = 0; //written only by the producer
+    volatile uint16_t tail = 0; //written only by the consumer
+
+    volatile uint16_t dropped = 0; //pushes refused because the queue was full; producer side
+
+public:
+    bool Push(const T& item) //producer only
+    {
+        uint16_t h = head;
+        if((uint16_t)(h - tail) == N)
+        {
+            dropped++;
+            return false;
+        }
+
+        items[h & (N - 1)] = item;
+        GPS_COMPILER_BARRIER(); //the item has to be in place before the consumer can see it
+        head = h + 1;
+
+        return true;
+    }
+
+    bool Pop(T& item) //consumer only
+    {
+        uint16_t t = tail;
+        if(t == head) return false;
+
+        GPS_COMPILER_BARRIER(); //don't read the slot before we know it's filled
+        item = items[t & (N - 1)];
+        GPS_COMPILER_BARRIER(); //and finish with it before handing it back
+        tail = t + 1;
+
+        return true;
+    }
+
+    uint16_t Count(void) const {return head - tail;}
+    bool IsEmpty(void) const {return head == tail;}
+    static constexpr uint16_t Capacity(void) {return N;}
+
+    uint16_t GetDropped(void) const {return dropped;}
+};
+
+#endif
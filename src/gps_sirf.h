@@ -0,0 +1,364 @@
+#ifndef __GPS_SIRF_H
+#define __GPS_SIRF_H
+
+#include <Arduino.h>
+
+#ifndef SIRF_MAX_PAYLOAD
+#define SIRF_MAX_PAYLOAD 188 //MID 4 (tracker data) is the longest of the navigation messages
+#endif
+
+#ifndef SIRF_STAMPS
+#define SIRF_STAMPS 8 //recent A0 A2s whose arrival times are kept, for frames restarted from one
+#endif
+
+enum MESSAGE_STATE {WAITING0, WAITING1, SIZE0, SIZE1, PAYLOAD, CHECK0, CHECK1, CLOSE0, CLOSE1, COMPLETE, LENGTH_ERROR = 252, EPILOG_ERROR = 253, CHECKSUM_ERROR = 254, ERROR = 255};
+
+class GPSMessage //view of a binary payload held by the framer; only valid until the next frame starts
+{
+public:
+    const uint8_t* payload = nullptr; //includes MID as byte 0
+    uint16_t length = 0;
+    uint8_t msgID = 0;
+
+public:
+    GPSMessage(void) {}
+    GPSMessage(const uint8_t* p, uint16_t len) : payload(p), length(len), msgID(len ? p[0] : 0) {}
+
+    uint16_t Length(void) const {return length;}
+    uint8_t operator[] (uint16_t i) const {return i < length ? payload[i] : 0;}
+
+    //big-endian fields, read in place; offsets are from the MID
+    uint8_t U8(uint16_t i) const {return (*this)[i];}
+    uint16_t U16(uint16_t i) const {return ((uint16_t)U8(i) << 8) | U8(i + 1);}
+    uint32_t U32(uint16_t i) const {return ((uint32_t)U16(i) << 16) | U16(i + 2);}
+    int16_t I16(uint16_t i) const {return (int16_t)U16(i);}
+    int32_t I32(uint16_t i) const {return (int32_t)U32(i);}
+};
+
+/*
+ * Typed views of the navigation messages. Nothing is copied: each accessor reads its
+ * field straight out of the framer's buffer, so a view is only good as long as the
+ * GPSMessage it was made from. Units are as sent by the receiver.
+ */
+class SiRFGeodeticNav //MID 41
+{
+protected:
+    GPSMessage msg;
+
+public:
+    enum {MID = 41, LENGTH = 91};
+
+    SiRFGeodeticNav(const GPSMessage& m) : msg(m) {}
+    bool IsValid(void) const {return msg.msgID == MID && msg.length >= LENGTH;}
+
+    uint16_t NavValid(void) const {return msg.U16(1);} //0 means a valid navigation solution
+    uint16_t NavType(void) const {return msg.U16(3);} //bits 0-2: fix type; bit 7: DGPS
+    uint16_t Week(void) const {return msg.U16(5);} //extended GPS week
+    uint32_t TOW(void) const {return msg.U32(7);} //GPS time of week, ms
+
+    uint16_t Year(void) const {return msg.U16(11);} //UTC
+    uint8_t Month(void) const {return msg.U8(13);}
+    uint8_t Day(void) const {return msg.U8(14);}
+    uint8_t Hour(void) const {return msg.U8(15);}
+    uint8_t Minute(void) const {return msg.U8(16);}
+    uint16_t SecondMS(void) const {return msg.U16(17);} //UTC seconds, ms
+
+    int32_t Latitude(void) const {return msg.I32(23);} //degrees * 10^7
+    int32_t Longitude(void) const {return msg.I32(27);} //degrees * 10^7
+    int32_t AltitudeEllipsoid(void) const {return msg.I32(31);} //cm
+    int32_t AltitudeMSL(void) const {return msg.I32(35);} //cm
+    uint16_t SpeedOverGround(void) const {return msg.U16(40);} //cm/s
+    uint16_t CourseOverGround(void) const {return msg.U16(42);} //degrees * 100
+    int16_t ClimbRate(void) const {return msg.I16(46);} //cm/s
+    uint32_t EHPE(void) const {return msg.U32(50);} //estimated horizontal position error, cm
+    uint32_t EVPE(void) const {return msg.U32(54);} //estimated vertical position error, cm
+    uint8_t SVsInFix(void) const {return msg.U8(88);}
+    uint8_t HDOP(void) const {return msg.U8(89);} //HDOP * 5
+};
+
+class SiRFMeasuredNav //MID 2
+{
+protected:
+    GPSMessage msg;
+
+public:
+    enum {MID = 2, LENGTH = 41};
+
+    SiRFMeasuredNav(const GPSMessage& m) : msg(m) {}
+    bool IsValid(void) const {return msg.msgID == MID && msg.length >= LENGTH;}
+
+    int32_t X(void) const {return msg.I32(1);} //ECEF, m
+    int32_t Y(void) const {return msg.I32(5);}
+    int32_t Z(void) const {return msg.I32(9);}
+    int16_t VX(void) const {return msg.I16(13);} //ECEF, m/s * 8
+    int16_t VY(void) const {return msg.I16(15);}
+    int16_t VZ(void) const {return msg.I16(17);}
+    uint8_t Mode1(void) const {return msg.U8(19);} //bits 0-2: fix type; bit 7: DGPS
+    uint8_t HDOP(void) const {return msg.U8(20);} //HDOP * 5
+    uint8_t Mode2(void) const {return msg.U8(21);}
+    uint16_t Week(void) const {return msg.U16(22);} //GPS week, mod 1024; see GPSFullWeek()
+    uint32_t TOW(void) const {return msg.U32(24);} //GPS time of week, s * 100
+    uint8_t SVsInFix(void) const {return msg.U8(28);}
+    uint8_t ChannelPRN(uint8_t ch) const {return ch < 12 ? msg.U8(29 + ch) : 0;}
+};
+
+class SiRFClockStatus //MID 7
+{
+protected:
+    GPSMessage msg;
+
+public:
+    enum {MID = 7, LENGTH = 20};
+
+    SiRFClockStatus(const GPSMessage& m) : msg(m) {}
+    bool IsValid(void) const {return msg.msgID == MID && msg.length >= LENGTH;}
+
+    uint16_t Week(void) const {return msg.U16(1);} //extended GPS week
+    uint32_t TOW(void) const {return msg.U32(3);} //GPS time of week, s * 100
+    uint8_t SVs(void) const {return msg.U8(7);}
+    uint32_t ClockDrift(void) const {return msg.U32(8);} //Hz
+    uint32_t ClockBias(void) const {return msg.U32(12);} //ns
+    uint32_t EstimatedGPSTime(void) const {return msg.U32(16);} //ms
+};
+
+class SiRFTrackerData //MID 4
+{
+protected:
+    GPSMessage msg;
+
+public:
+    enum {MID = 4, HEADER = 8, CHANNEL = 15};
+
+    SiRFTrackerData(const GPSMessage& m) : msg(m) {}
+    bool IsValid(void) const {return msg.msgID == MID && msg.length >= HEADER;}
+
+    int16_t Week(void) const {return msg.I16(1);} //GPS week, mod 1024; see GPSFullWeek()
+    uint32_t TOW(void) const {return msg.U32(3);} //GPS time of week, s * 100
+    uint8_t Channels(void) const //as many as the message really holds
+    {
+        uint8_t claimed = msg.U8(7);
+        uint8_t held = (msg.length - HEADER) / CHANNEL;
+        return claimed < held ? claimed : held;
+    }
+
+    uint8_t SVID(uint8_t ch) const {return msg.U8(HEADER + ch * CHANNEL);}
+    uint8_t Azimuth(uint8_t ch) const {return msg.U8(HEADER + ch * CHANNEL + 1);} //degrees * 2/3
+    uint8_t Elevation(uint8_t ch) const {return msg.U8(HEADER + ch * CHANNEL + 2);} //degrees * 2
+    uint16_t State(uint8_t ch) const {return msg.U16(HEADER + ch * CHANNEL + 3);}
+    uint8_t CN0(uint8_t ch, uint8_t i) const {return i < 10 ? msg.U8(HEADER + ch * CHANNEL + 5 + i) : 0;} //dB-Hz, one per 100 ms
+};
+
+class SiRFFramer
+/*
+ * Byte-at-a-time framing of SiRF binary messages:
+ *
+ *   A0 A2 | length (2, big-endian) | payload | checksum (2, big-endian) | B0 B3
+ *
+ * The raw frame goes straight into a fixed buffer. Frames that claim to be longer than
+ * SIRF_MAX_PAYLOAD (or empty) are rejected as soon as the length arrives.
+ *
+ * When a frame fails (length, checksum or epilog), the bytes it swallowed are rescanned
+ * for the next A0 A2 and replayed from there, so a real frame that started inside a
+ * false one isn't lost. Replayed bytes are processed one per call to Replay(); keep
+ * calling it while Replaying() before feeding new bytes. Bytes that are thrown away
+ * are counted in GetSkippedBytes(). A failure invalidates the last GetMessage() view
+ * (it comes back empty), since the replayed bytes are shuffled over it.
+ *
+ * StartMicros() is when the frame's A0 came in, even if the frame was rebuilt from
+ * replayed bytes: each byte is numbered as it arrives, and the times of the last few
+ * A0 A2s (SIRF_STAMPS) are kept. If a frame restarts from one older than that, it gets
+ * the start of the frame that failed around it instead.
+ */
+{
+protected:
+    MESSAGE_STATE state = WAITING0;
+
+    uint16_t msgLen = 0;
+    uint16_t messageLen = 0; //payload length of the last completed frame; 0 once a new payload starts
+    uint16_t runningSum = 0;
+
+    uint8_t frame[SIRF_MAX_PAYLOAD + 8]; //the raw frame so far; the payload starts at frame[4]
+    uint16_t frameLen = 0;
+
+    //bytes waiting to be replayed after a failure, frame[replayIndex] up to frame[replayEnd];
+    //the frame being rebuilt never catches up with them, since each byte adds at most one
+    uint16_t replayIndex = 0;
+    uint16_t replayEnd = 0;
+
+    uint32_t skippedBytes = 0;
+
+    uint32_t startMicros = 0; //micros() when the frame's A0 came in
+
+    //the byte being stepped is number arrivals, less the bytes still waiting to be replayed
+    uint16_t arrivals = 0; //bytes taken by AddByte(), mod 2^16
+    uint16_t lastA0 = 0; //the number of the last A0 in
+    uint32_t lastA0Micros = 0;
+    struct {uint16_t arrival; uint32_t micros;} stamps[SIRF_STAMPS] = {}; //A0s that were followed by A2
+    uint8_t stampIndex = 0;
+
+    uint32_t ArrivalMicros(void) const //of the byte being stepped, if it's an A0
+    {
+        uint16_t arrival = arrivals - (replayEnd - replayIndex);
+        if(arrival == lastA0) return lastA0Micros;
+
+        for(uint8_t i = 0; i < SIRF_STAMPS; i++)
+            if(stamps[i].arrival == arrival) return stamps[i].micros;
+
+        return startMicros; //too long ago; the frame that failed around it started earlier
+    }
+
+    MESSAGE_STATE Step(uint8_t b)
+    {
+        switch(state)
+        {
+            case WAITING0:
+                if(b == 0xA0)
+                {
+                    startMicros = ArrivalMicros();
+                    frame[0] = b;
+                    frameLen = 1;
+                    state = WAITING1;
+                }
+                else skippedBytes++;
+                break;
+            case WAITING1:
+                if(b == 0xA2)
+                {
+                    frame[frameLen++] = b;
+                    state = SIZE0;
+                }
+                else if(b == 0xA0) //the earlier A0 goes; this one might be a start
+                {
+                    startMicros = ArrivalMicros();
+                    skippedBytes++;
+                }
+                else
+                {
+                    skippedBytes += 2;
+                    frameLen = 0;
+                    state = WAITING0;
+                }
+                break;
+            case SIZE0:
+                frame[frameLen++] = b;
+                msgLen = (uint16_t)b << 8;
+                state = SIZE1;
+                break;
+            case SIZE1:
+                frame[frameLen++] = b;
+                msgLen |= b;
+                if(msgLen == 0 || msgLen > SIRF_MAX_PAYLOAD) return Fail(LENGTH_ERROR);
+                runningSum = 0;
+                messageLen = 0;
+                state = PAYLOAD;
+                break;
+            case PAYLOAD:
+                frame[frameLen++] = b;
+                runningSum += b;
+                if(frameLen == msgLen + 4) state = CHECK0;
+                break;
+            case CHECK0:
+                frame[frameLen++] = b;
+                state = CHECK1;
+                break;
+            case CHECK1:
+                frame[frameLen++] = b;
+                if((((uint16_t)frame[frameLen - 2] << 8) | b) != (runningSum & 0x7fff)) return Fail(CHECKSUM_ERROR);
+                state = CLOSE0;
+                break;
+            case CLOSE0:
+                frame[frameLen++] = b;
+                if(b != 0xB0) return Fail(EPILOG_ERROR);
+                state = CLOSE1;
+                break;
+            case CLOSE1:
+                frame[frameLen++] = b;
+                if(b != 0xB3) return Fail(EPILOG_ERROR);
+                messageLen = msgLen;
+                frameLen = 0;
+                state = WAITING0;
+                return COMPLETE;
+            default:
+                state = WAITING0;
+        }
+
+        return state;
+    }
+
+    MESSAGE_STATE Fail(MESSAGE_STATE error)
+    {
+        messageLen = 0; //the shuffle below can land on the last payload, so its view goes now
+
+        //look for the next possible start in what we've consumed, skipping the first A0
+        uint16_t start = 1;
+        while(start < frameLen && !(frame[start] == 0xA0 && (start + 1 == frameLen || frame[start + 1] == 0xA2))) start++;
+        skippedBytes += start;
+
+        //anything still waiting to be replayed has to go after what we keep
+        uint16_t pending = replayEnd - replayIndex;
+        memmove(frame + frameLen, frame + replayIndex, pending);
+        replayIndex = start;
+        replayEnd = frameLen + pending;
+        if(replayIndex == replayEnd) replayIndex = replayEnd = 0;
+
+        frameLen = 0;
+        state = WAITING0;
+
+        return error;
+    }
+
+public:
+    MESSAGE_STATE AddByte(uint8_t b)
+    {
+        arrivals++;
+        if(b == 0xA0)
+        {
+            lastA0 = arrivals;
+            lastA0Micros = micros();
+        }
+
+        else if(b == 0xA2 && lastA0 == (uint16_t)(arrivals - 1)) //a possible start, which a failure might replay
+        {
+            stamps[stampIndex].arrival = lastA0;
+            stamps[stampIndex].micros = lastA0Micros;
+            stampIndex = (stampIndex + 1) % SIRF_STAMPS;
+        }
+
+        if(!Replaying()) return Step(b);
+
+        //still replaying, so queue b behind the replayed bytes and process the oldest
+        if(replayEnd == sizeof(frame))
+        {
+            messageLen = 0; //as in Fail()
+            memmove(frame + frameLen, frame + replayIndex, replayEnd - replayIndex);
+            replayEnd -= replayIndex - frameLen;
+            replayIndex = frameLen;
+        }
+
+        if(replayEnd < sizeof(frame)) frame[replayEnd++] = b;
+        else skippedBytes++; //nowhere to put it; only happens if the caller ignores Replaying()
+
+        return Replay();
+    }
+
+    MESSAGE_STATE Replay(void) //processes one replayed byte
+    {
+        if(!Replaying()) return state;
+
+        uint8_t b = frame[replayIndex++];
+        if(replayIndex == replayEnd) replayIndex = replayEnd = 0;
+
+        return Step(b);
+    }
+
+    bool Replaying(void) const {return replayIndex < replayEnd;}
+
+    void Reset(void) {state = WAITING0; frameLen = replayIndex = replayEnd = 0;}
+
+    MESSAGE_STATE GetState(void) const {return state;}
+    uint32_t GetSkippedBytes(void) const {return skippedBytes;}
+    uint32_t StartMicros(void) const {return startMicros;} //when the A0 of the last frame started (or completed) came in
+    GPSMessage GetMessage(void) const {return GPSMessage(frame + 4, messageLen);}
+};
+
+#endif
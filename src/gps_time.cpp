@@ -0,0 +1,40 @@
+#include <gps_time.h>
+
+void GPSCivilFromDays(int32_t days, uint16_t& year, uint8_t& month, uint8_t& day)
+/*
+ * Counts in 400-year eras that start on Mar 1, so the leap day is the last of its year
+ * (after H. Hinnant's civil_from_days). 32-bit only: no 64-bit division on a Cortex-M0.
+ */
+{
+    days += 719468; //from 0000-03-01
+    int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    uint32_t dayOfEra = days - era * 146097; //0 - 146096
+    uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365; //0 - 399
+    uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100); //0 - 365, from Mar 1
+    uint32_t mp = (5 * dayOfYear + 2) / 153; //0 - 11, from March
+
+    day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = yearOfEra + era * 400 + (month <= 2);
+}
+
+uint64_t GPSEpochNear(uint32_t timeOfDayMS, uint64_t reference)
+{
+    uint64_t time = (uint64_t)GPSDayFromEpochMS(reference) * GPS_MS_PER_DAY + timeOfDayMS;
+
+    if(time + GPS_MS_PER_DAY / 2 < reference) time += GPS_MS_PER_DAY; //past midnight since
+    else if(time > reference + GPS_MS_PER_DAY / 2) time -= GPS_MS_PER_DAY; //before midnight
+
+    return time;
+}
+
+void GPSWeekFromEpochMS(uint64_t epochMS, uint16_t& week, uint32_t& towMS, int8_t leap)
+/*
+ * As GPSDayFromEpochMS(): a week is 2^10 * 590625 ms. The time of week is under 2^32, so
+ * it comes out of the low words alone.
+ */
+{
+    uint64_t gpsMS = epochMS + leap * 1000LL - GPS_EPOCH_UNIX * 1000ULL;
+    week = (uint32_t)(gpsMS >> 10) / (GPS_MS_PER_WEEK >> 10);
+    towMS = (uint32_t)gpsMS - week * GPS_MS_PER_WEEK;
+}
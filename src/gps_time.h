@@ -0,0 +1,72 @@
+#ifndef __GPS_TIME_H
+#define __GPS_TIME_H
+
+#include <Arduino.h>
+
+/*
+ * Calendar arithmetic for fix times: Unix time in ms (UTC, from 1970-01-01) to and from
+ * the date and time of day a receiver sends, and GPS week and time of week, as SiRF binary
+ * messages carry them. Everything is integer, and the forward conversions are constexpr,
+ * so a fixed date costs nothing at run time; the date itself is a table lookup and a few
+ * multiplies. The way back only divides in 32 bits: the M0+ has no divider, and a 64-bit
+ * division is a long library call.
+ *
+ * Dates are Gregorian, good from 1970 to 2105. Two-digit years (as GPSDatum keeps them)
+ * are 1980 - 2079: GPS time starts in 1980.
+ */
+
+#define GPS_MS_PER_DAY 86400000UL
+#define GPS_MS_PER_WEEK 604800000UL
+#define GPS_EPOCH_UNIX 315964800UL //s from 1970-01-01 to the start of GPS time, 1980-01-06
+
+#ifndef GPS_LEAP_SECONDS
+#define GPS_LEAP_SECONDS 18 //GPS time - UTC, since 2017-01-01
+#endif
+
+//days in the year before the first of each month (1 - 12), not counting Feb 29
+static constexpr uint16_t gpsDaysBeforeMonth[13] = {0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+constexpr uint16_t GPSFullYear(uint8_t year) {return year < 80 ? 2000 + year : 1900 + year;}
+constexpr bool GPSIsLeapYear(uint16_t year) {return !(year % 4) && ((year % 100) || !(year % 400));}
+
+constexpr int32_t GPSLeapDays(uint16_t year) //Feb 29ths from 1970 up to the start of year
+{
+    return (year - 1) / 4 - (year - 1) / 100 + (year - 1) / 400 - 477; //477 of them before 1970
+}
+
+constexpr int32_t GPSDaysFromCivil(uint16_t year, uint8_t month, uint8_t day) //days since 1970-01-01
+{
+    return (year - 1970) * 365L + GPSLeapDays(year) + gpsDaysBeforeMonth[month] + (month > 2 && GPSIsLeapYear(year)) + day - 1;
+}
+
+constexpr uint64_t GPSEpochMS(uint16_t year, uint8_t month, uint8_t day, uint32_t timeOfDayMS)
+{
+    return (uint64_t)GPSDaysFromCivil(year, month, day) * GPS_MS_PER_DAY + timeOfDayMS;
+}
+
+void GPSCivilFromDays(int32_t days, uint16_t& year, uint8_t& month, uint8_t& day);
+
+//days since 1970-01-01 for a Unix time in ms: a day is 2^10 * 84375 ms, and ms >> 10 fits in 32 bits until 2109
+constexpr uint32_t GPSDayFromEpochMS(uint64_t ms) {return (uint32_t)(ms >> 10) / (GPS_MS_PER_DAY >> 10);}
+
+/*
+ * For a time of day without a date (GGA): the Unix time within 12 hours of reference,
+ * e.g., the last dated fix, so a fix just past midnight lands on the next day.
+ */
+uint64_t GPSEpochNear(uint32_t timeOfDayMS, uint64_t reference);
+
+//GPS week (full, not mod 1024) and time of week in ms; leap is GPS - UTC in s
+constexpr uint64_t GPSEpochMSFromWeek(uint16_t week, uint32_t towMS, int8_t leap = GPS_LEAP_SECONDS)
+{
+    return GPS_EPOCH_UNIX * 1000ULL + week * (uint64_t)GPS_MS_PER_WEEK + towMS - leap * 1000LL;
+}
+
+void GPSWeekFromEpochMS(uint64_t epochMS, uint16_t& week, uint32_t& towMS, int8_t leap = GPS_LEAP_SECONDS);
+
+//the full week for a week mod 1024 (MIDs 2 and 4), taking the one nearest to reference
+constexpr uint16_t GPSFullWeek(uint16_t week, uint16_t reference)
+{
+    return reference + ((((week - reference) & 1023) ^ 512) - 512);
+}
+
+#endif
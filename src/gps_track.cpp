@@ -0,0 +1,240 @@
+#include <gps_track.h>
+#include <gps_geo.h>
+
+static uint8_t PutVarint(uint8_t* out, uint32_t value) //LEB128; returns the number of bytes (1 - 5)
+{
+    uint8_t n = 0;
+    while(value >= 0x80)
+    {
+        out[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+
+    out[n++] = value;
+    return n;
+}
+
+static uint32_t ZigZag(int32_t value) {return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);}
+static int32_t UnZigZag(uint32_t value) {return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);}
+
+static void PutU32(uint8_t* out, uint32_t value)
+{
+    for(uint8_t i = 0; i < 4; i++) out[i] = value >> (8 * i);
+}
+
+static uint32_t GetU32(const uint8_t* in)
+{
+    return in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+bool GPSTrackEncoder::Add(const GPSDatum& datum)
+{
+    uint32_t time = datum.TimeOfDayMS();
+
+    bool key = !haveKey || sinceKey >= keyInterval || time < lastTime
+               || datum.gpsFix != last.gpsFix || datum.day != last.day || datum.month != last.month || datum.year != last.year;
+
+    if(!(key ? WriteKeyframe(datum) : WriteDelta(datum))) return false;
+
+    sinceKey = key ? 0 : sinceKey + 1;
+    lastStep = key ? 0 : time - lastTime;
+    lastTime = time;
+    last = datum;
+
+    return true;
+}
+
+bool GPSTrackEncoder::WriteKeyframe(const GPSDatum& datum)
+{
+    if(length + TRACK_KEYFRAME_LENGTH > size) return false;
+
+    uint8_t* out = buffer + length;
+    out[0] = TRACK_KEYFRAME;
+    out[1] = datum.year;
+    out[2] = datum.month;
+    out[3] = datum.day;
+    PutU32(out + 4, datum.TimeOfDayMS());
+    PutU32(out + 8, datum.lat);
+    PutU32(out + 12, datum.lon);
+    out[16] = datum.elevDM;
+    out[17] = datum.elevDM >> 8;
+    out[18] = datum.gpsFix;
+
+    uint8_t check = 0;
+    for(uint8_t i = 0; i < TRACK_KEYFRAME_LENGTH - 1; i++) check ^= out[i];
+    out[TRACK_KEYFRAME_LENGTH - 1] = check;
+
+    length += TRACK_KEYFRAME_LENGTH;
+    haveKey = true;
+
+    return true;
+}
+
+bool GPSTrackEncoder::WriteDelta(const GPSDatum& datum)
+{
+    uint8_t record[1 + 4 * 5];
+    uint8_t n = 1;
+    uint8_t fields = 0;
+
+    uint32_t step = datum.TimeOfDayMS() - lastTime;
+    if(step != lastStep)
+    {
+        fields |= TRACK_DT;
+        n += PutVarint(record + n, step);
+    }
+
+    if(datum.lat != last.lat)
+    {
+        fields |= TRACK_LAT;
+        n += PutVarint(record + n, ZigZag(datum.lat - last.lat));
+    }
+
+    if(datum.lon != last.lon)
+    {
+        fields |= TRACK_LON;
+        n += PutVarint(record + n, ZigZag(datum.lon - last.lon));
+    }
+
+    if(datum.elevDM != last.elevDM)
+    {
+        fields |= TRACK_ELEV;
+        n += PutVarint(record + n, ZigZag(datum.elevDM - last.elevDM));
+    }
+
+    if(length + n > size) return false;
+
+    record[0] = TRACK_DELTA | fields;
+    memcpy(buffer + length, record, n);
+    length += n;
+
+    return true;
+}
+
+bool GPSTrackDecoder::ReadVarint(uint32_t& value)
+{
+    value = 0;
+    for(uint8_t shift = 0; shift < 35 && index < length; shift += 7)
+    {
+        uint8_t b = data[index++];
+        value |= (uint32_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)) return true;
+    }
+
+    return false;
+}
+
+bool GPSTrackDecoder::ReadKeyframe(void)
+{
+    if(index + TRACK_KEYFRAME_LENGTH > length) return false;
+
+    const uint8_t* in = data + index;
+    uint8_t check = 0;
+    for(uint8_t i = 0; i < TRACK_KEYFRAME_LENGTH - 1; i++) check ^= in[i];
+    if(check != in[TRACK_KEYFRAME_LENGTH - 1]) return false;
+
+    last = GPSDatum(0);
+    last.year = in[1];
+    last.month = in[2];
+    last.day = in[3];
+
+    uint32_t time = GetU32(in + 4);
+    last.SetTimeOfDayMS(time);
+
+    last.lat = GetU32(in + 8);
+    last.lon = GetU32(in + 12);
+    last.elevDM = in[16] | (in[17] << 8);
+    last.gpsFix = in[18];
+    last.source = GGA | RMC;
+
+    lastTime = time;
+    lastStep = 0;
+    haveKey = true;
+    index += TRACK_KEYFRAME_LENGTH;
+
+    return true;
+}
+
+bool GPSTrackDecoder::Next(GPSDatum& datum)
+{
+    while(index < length)
+    {
+        uint8_t tag = data[index];
+
+        if(tag == 0) //padding
+        {
+            index++;
+            continue;
+        }
+
+        if(tag == TRACK_KEYFRAME && ReadKeyframe())
+        {
+            datum = last;
+            return true;
+        }
+
+        if((tag & TRACK_DELTA) && !(tag & 0x70) && haveKey)
+        {
+            uint16_t start = index++;
+            uint32_t step = lastStep, value;
+            bool ok = true;
+
+            if(tag & TRACK_DT) ok = ReadVarint(step);
+
+            int32_t dLat = 0, dLon = 0, dElev = 0;
+            if(ok && (tag & TRACK_LAT)) {ok = ReadVarint(value); dLat = UnZigZag(value);}
+            if(ok && (tag & TRACK_LON)) {ok = ReadVarint(value); dLon = UnZigZag(value);}
+            if(ok && (tag & TRACK_ELEV)) {ok = ReadVarint(value); dElev = UnZigZag(value);}
+
+            if(ok)
+            {
+                uint32_t time = lastTime + step;
+                last.SetTimeOfDayMS(time);
+
+                last.lat += dLat;
+                last.lon += dLon;
+                last.elevDM += dElev;
+
+                lastTime = time;
+                lastStep = step;
+
+                datum = last;
+                return true;
+            }
+
+            index = start; //ran off the end; fall through and resync
+        }
+
+        //not something we can read here: skip to the next keyframe
+        haveKey = false;
+        errors++;
+        index++;
+    }
+
+    return false;
+}
+
+int32_t GPSTrackLonScale(int32_t lat)
+{
+    return GeoCos(GeoAngleFromDMM(lat)) >> 15;
+}
+
+uint32_t GPSTrackDeviation(const GPSTrackPoint& a, const GPSTrackPoint& b, const GPSTrackPoint& p, int32_t lonScale)
+/*
+ * Distance from p to the segment a-b, in DMM of latitude, with longitudes scaled by
+ * lonScale (Q15) so that both axes are in the same units.
+ */
+{
+    int64_t bx = ((int64_t)(b.lon - a.lon) * lonScale) >> 15, by = b.lat - a.lat;
+    int64_t px = ((int64_t)(p.lon - a.lon) * lonScale) >> 15, py = p.lat - a.lat;
+
+    int64_t dot = bx * px + by * py;
+    int64_t length2 = bx * bx + by * by;
+
+    if(dot <= 0 || length2 == 0) return GeoSqrt(px * px + py * py); //nearest a
+    if(dot >= length2) return GeoSqrt((px - bx) * (px - bx) + (py - by) * (py - by)); //nearest b
+
+    int64_t cross = bx * py - by * px;
+    if(cross < 0) cross = -cross;
+
+    return cross / GeoSqrt(length2);
+}
@@ -0,0 +1,255 @@
+#ifndef __GPS_TRACK_H
+#define __GPS_TRACK_H
+
+#include <gps.h>
+
+/*
+ * Compact binary track log. A log is a sequence of records:
+ *
+ *   keyframe  0x01, year, month, day, time of day (ms, u32), lat (DMM, i32), lon (DMM, i32),
+ *             elevDM (i16), gpsFix, check -- 20 bytes, little-endian; check is the XOR of
+ *             the 19 bytes before it
+ *   delta     0x80 | fields, then for each field present, in this order:
+ *               TRACK_DT     ms since the last fix (varint), when it differs from the last step
+ *               TRACK_LAT    change in lat (zigzag varint)
+ *               TRACK_LON    change in lon (zigzag varint)
+ *               TRACK_ELEV   change in elevDM (zigzag varint)
+ *   padding   0x00, skipped (e.g., the unused end of an SD block)
+ *
+ * A delta with no fields is a fix that repeats the last step in time and nothing else.
+ * Keyframes are written at the start of every buffer, every keyInterval fixes, and
+ * whenever the date or fix changes, so any buffer (block) decodes on its own.
+ */
+
+#define TRACK_KEYFRAME 0x01
+#define TRACK_KEYFRAME_LENGTH 20
+#define TRACK_DELTA 0x80
+
+#define TRACK_DT 0x01
+#define TRACK_LAT 0x02
+#define TRACK_LON 0x04
+#define TRACK_ELEV 0x08
+
+class GPSTrackEncoder
+{
+protected:
+    uint8_t* buffer;
+    uint16_t size;
+    uint16_t length = 0;
+
+    uint16_t keyInterval;
+    uint16_t sinceKey = 0;
+    bool haveKey = false; //false until a keyframe is in the buffer
+
+    GPSDatum last;
+    uint32_t lastTime = 0; //time of day, ms
+    uint32_t lastStep = 0;
+
+    bool WriteKeyframe(const GPSDatum& datum);
+    bool WriteDelta(const GPSDatum& datum);
+
+public:
+    GPSTrackEncoder(uint8_t* buf, uint16_t bufSize, uint16_t interval = 60)
+        : buffer(buf), size(bufSize), keyInterval(interval), last(0) {}
+
+    bool Add(const GPSDatum& datum); //false if it didn't fit: write out the buffer, Clear(), and Add() again
+
+    const uint8_t* GetData(void) const {return buffer;}
+    uint16_t GetLength(void) const {return length;}
+
+    void Clear(void) //the next fix starts with a keyframe
+    {
+        length = 0;
+        haveKey = false;
+    }
+
+    uint16_t Pad(void) //fills the rest of the buffer with padding; returns the whole length
+    {
+        while(length < size) buffer[length++] = 0;
+        return length;
+    }
+};
+
+class GPSTrackDecoder
+/*
+ * Reads records back out of a buffer. Deltas that don't follow a keyframe are skipped,
+ * and after a bad byte the decoder scans forward for the next keyframe with a good check.
+ */
+{
+protected:
+    const uint8_t* data;
+    uint16_t length;
+    uint16_t index = 0;
+
+    bool haveKey = false;
+    GPSDatum last;
+    uint32_t lastTime = 0;
+    uint32_t lastStep = 0;
+
+    uint16_t errors = 0;
+
+    bool ReadKeyframe(void);
+    bool ReadVarint(uint32_t& value);
+
+public:
+    GPSTrackDecoder(const uint8_t* bytes, uint16_t len) : data(bytes), length(len), last(0) {}
+
+    bool Next(GPSDatum& datum); //false at the end of the data
+
+    uint16_t GetErrors(void) const {return errors;} //bytes skipped to find a keyframe
+};
+
+struct GPSTrackPoint
+{
+    uint32_t time; //ms since 00:00 UTC on the day the track started
+    int32_t lat; //DMM
+    int32_t lon;
+    int16_t elevDM;
+};
+
+int32_t GPSTrackLonScale(int32_t lat); //cos(lat) in Q15, for treating DMM of longitude like DMM of latitude
+uint32_t GPSTrackDeviation(const GPSTrackPoint& a, const GPSTrackPoint& b, const GPSTrackPoint& p, int32_t lonScale);
+
+template <uint16_t N, uint8_t W = 16> class GPSTrackStore
+/*
+ * Keeps a track in N points, however long it runs. Fixes are simplified as they come
+ * in (sliding window): a fix is only kept if leaving it out would put one of the fixes
+ * since the last kept point more than the tolerance (DMM of latitude, ~0.185 m) off the
+ * line. At most W fixes are held back, so a long straight run still gets a point every
+ * W fixes. When the store fills, the kept points are simplified again, at the smallest
+ * tolerance (doubling from the current one) that frees a quarter of the store. Since
+ * each pass works on the points the last one kept, the track stays within the sum of
+ * the tolerances of the passes so far -- GetMaxDeviation() -- of the path, start to end.
+ *
+ * The latest fix is always the last point.
+ */
+{
+    static_assert(N >= 4, "GPSTrackStore needs room for a few points");
+
+protected:
+    GPSTrackPoint points[N];
+    uint16_t count = 0; //kept points
+
+    GPSTrackPoint window[W]; //fixes since the last kept point; the last one is the tip
+    uint8_t windowCount = 0;
+
+    uint32_t baseTolerance; //as configured; Compact() raises tolerance from there
+    uint32_t tolerance;
+    uint32_t maxDeviation; //the tolerances of the passes so far, added up
+    int32_t lonScale = 32768;
+
+    uint32_t lastTime = 0;
+    uint32_t dayOffset = 0;
+
+    bool Fits(const GPSTrackPoint& anchor, const GPSTrackPoint& tip, const GPSTrackPoint* between, uint16_t n, uint32_t limit) const
+    {
+        for(uint16_t i = 0; i < n; i++)
+            if(GPSTrackDeviation(anchor, tip, between[i], lonScale) > limit) return false;
+
+        return true;
+    }
+
+    void Keep(const GPSTrackPoint& point)
+    {
+        if(count >= N - 1) Compact(); //the tip, in the window, takes the last slot
+        points[count++] = point;
+    }
+
+    uint16_t Simplify(uint32_t limit, bool apply) //the number of points a pass at limit keeps; applies it if asked
+    {
+        //in place: points are only ever written at or below the anchor's old index
+        uint16_t kept = 1, anchor = 0;
+        GPSTrackPoint last = points[0];
+        for(uint16_t i = 2; i < count; i++)
+        {
+            //points[anchor + 1 .. i - 1] are candidates for dropping
+            if(!Fits(last, points[i], points + anchor + 1, i - anchor - 1, limit))
+            {
+                last = points[i - 1];
+                if(apply) points[kept] = last;
+                kept++;
+                anchor = i - 1;
+            }
+        }
+
+        if(apply) points[kept] = points[count - 1];
+        return kept + 1;
+    }
+
+    void Compact(void) //frees at least a quarter of the store
+    {
+        uint32_t limit = tolerance;
+        while(Simplify(limit, false) > N * 3 / 4 && limit < 0x80000000UL) limit = limit ? limit * 2 : 1;
+
+        count = Simplify(limit, true);
+        tolerance = limit;
+        maxDeviation = maxDeviation + limit < maxDeviation ? UINT32_MAX : maxDeviation + limit;
+    }
+
+public:
+    GPSTrackStore(uint32_t toleranceDMM = 50) : baseTolerance(toleranceDMM), tolerance(toleranceDMM), maxDeviation(toleranceDMM) {}
+
+    void Add(const GPSDatum& datum)
+    {
+        GPSTrackPoint point;
+        uint32_t time = datum.TimeOfDayMS();
+        if(count && time + 43200000UL < lastTime) dayOffset += 86400000UL; //past midnight
+        lastTime = time;
+
+        point.time = time + dayOffset;
+        point.lat = datum.lat;
+        point.lon = datum.lon;
+        point.elevDM = datum.elevDM;
+
+        if(!count)
+        {
+            lonScale = GPSTrackLonScale(point.lat);
+            Keep(point);
+            return;
+        }
+
+        if(windowCount == W || !Fits(points[count - 1], point, window, windowCount, tolerance))
+        {
+            Keep(window[windowCount - 1]); //the tip so far becomes a corner
+            windowCount = 0;
+        }
+
+        window[windowCount++] = point;
+    }
+
+    uint16_t Count(void) const {return count + (windowCount ? 1 : 0);}
+    const GPSTrackPoint& operator[] (uint16_t i) const {return i < count ? points[i] : window[windowCount - 1];}
+
+    uint16_t Find(uint32_t time) const //index of the first point at or after time; Count() if none
+    {
+        uint16_t low = 0, high = Count();
+        while(low < high)
+        {
+            uint16_t mid = (low + high) / 2;
+            if((*this)[mid].time < time) low = mid + 1;
+            else high = mid;
+        }
+
+        return low;
+    }
+
+    uint16_t GetRange(uint32_t from, uint32_t to, GPSTrackPoint* out, uint16_t max) const //points with from <= time <= to
+    {
+        uint16_t n = 0;
+        for(uint16_t i = Find(from); i < Count() && (*this)[i].time <= to && n < max; i++) out[n++] = (*this)[i];
+
+        return n;
+    }
+
+    uint32_t GetTolerance(void) const {return tolerance;}
+    uint32_t GetMaxDeviation(void) const {return maxDeviation;} //DMM of latitude; see above
+
+    void Clear(void)
+    {
+        count = windowCount = 0;
+        dayOffset = lastTime = 0;
+        tolerance = maxDeviation = baseTolerance;
+    }
+};
+
+#endif